@@ -0,0 +1,392 @@
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "meshgen.h"
+#include "../src/camerapath.h"
+#include "../src/depthbuffer.h"
+#include "../src/framebuffer.h"
+#include "../src/framerenderer.h"
+#include "../src/geometry.h"
+#include "../src/model.h"
+#include "../src/rasterizer.h"
+#include "../src/simd.h"
+#include "../src/tgareader.h"
+#include "../src/tgawriter.h"
+#include "../src/threadpool.h"
+#include "../dependencies/tgaimage.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const TGAColor white{ 255, 255, 255, 255 };
+const Camera camera{ Vec3f{ 1, 1, 3 }, Vec3f{ 0, 0, 0 } };
+const auto lightDir = Vec3f{ 1, -1, 1 }.normalize();
+
+// Triangles drawn per run of the rasterizer benchmarks
+const int BATCH = 4096;
+
+struct Options {
+    std::string output;
+    std::string filter;
+    std::string workDir{ "bench-data" };
+    std::string model{ "../resources/african_head.obj" };
+    double minSeconds = .5;
+    int minRuns = 5;
+    int threads = 0;
+    long maxTriangles = 10'000'000;
+};
+
+// Model loading talks a lot, the benchmarks log their own results
+class QuietStderr {
+public:
+    QuietStderr() : mBuf(std::cerr.rdbuf(nullptr)) {}
+    ~QuietStderr() { std::cerr.rdbuf(mBuf); std::cerr.clear(); }
+
+private:
+    std::streambuf *mBuf;
+};
+
+std::unique_ptr<Model> loadModel(const std::string& filename, ThreadPool& pool, bool useCache) {
+    QuietStderr quiet;
+    return std::make_unique<Model>(filename.c_str(), pool, useCache);
+}
+
+// Random triangles with sides of about size pixels inside a square target 16
+// sizes wide, so every batch covers the target about eight times whatever the size
+std::vector<std::array<Vec3f, 3>> randomTriangles(int size, int target, std::mt19937& rng) {
+    std::uniform_real_distribution<float> pos{ 0, static_cast<float>(target - size) };
+    std::uniform_real_distribution<float> offset{ 0, static_cast<float>(size) };
+    std::uniform_real_distribution<float> depth{ 0, 255 };
+    std::vector<std::array<Vec3f, 3>> res(BATCH);
+    for (auto& t: res) {
+        const Vec3f origin{ pos(rng), pos(rng), 0 };
+        for (auto& v: t) {
+            v = origin + Vec3f{ offset(rng), offset(rng), depth(rng) };
+        }
+    }
+    return res;
+}
+
+void benchRasterizers(BenchRunner& runner) {
+    std::mt19937 rng{ 1 };
+    for (const auto size: { 4, 16, 64 }) {
+        const auto target = std::max(64, size * 16);
+        const auto tris = randomTriangles(size, target, rng);
+        Framebuffer frame{ target, target };
+        std::vector<float> zbuffer(static_cast<std::size_t>(target) * target);
+
+        runner.run("triangle", { param("size", size) }, BATCH, [&] {
+            std::fill(zbuffer.begin(), zbuffer.end(), DepthBuffer::FAR);
+            for (auto t: tris) {
+                triangle(t, zbuffer.data(), frame, white);
+            }
+        });
+
+        TGAImage image{ target, target, TGAImage::RGBA };
+        std::vector<int> izbuffer(zbuffer.size());
+        runner.run("triangleOld", { param("size", size) }, BATCH, [&] {
+            std::fill(izbuffer.begin(), izbuffer.end(), std::numeric_limits<int>::min());
+            for (const auto& t: tris) {
+                std::array<Vec3i, 3> v{ Vec3i{ t[0] }, Vec3i{ t[1] }, Vec3i{ t[2] } };
+                std::array<float, 3> ity{ .2f, .6f, 1.f };
+                triangleOld(v, ity, image, izbuffer.data());
+            }
+        });
+
+        const Rect viewport{ 0, 0, target, target };
+        runner.run("rasterize", { param("size", size), param("simd", simdName(simdLevel())) }, BATCH, [&] {
+            std::fill(zbuffer.begin(), zbuffer.end(), DepthBuffer::FAR);
+            for (const auto& t: tris) {
+                TriangleSetup s;
+                if (setupTriangle(t, { .2f, .6f, 1.f }, viewport, s)) {
+                    rasterize(s, viewport, zbuffer.data(), frame, white);
+                }
+            }
+        });
+
+        runner.run("rasterizeDepth", { param("size", size), param("simd", simdName(simdLevel())) }, BATCH, [&] {
+            std::fill(zbuffer.begin(), zbuffer.end(), DepthBuffer::FAR);
+            for (const auto& t: tris) {
+                TriangleSetup s;
+                if (setupTriangle(t, { .2f, .6f, 1.f }, viewport, s)) {
+                    rasterizeDepth(s, viewport, zbuffer.data(), target);
+                }
+            }
+        });
+    }
+
+    for (const auto length: { 16, 256 }) {
+        const auto target = length * 2;
+        std::uniform_int_distribution<int> pos{ 0, target - 1 };
+        std::vector<std::array<Vec2i, 2>> lines(BATCH);
+        for (auto& l: lines) {
+            l[0] = Vec2i{ pos(rng), pos(rng) };
+            l[1] = Vec2i{ pos(rng), pos(rng) };
+        }
+        TGAImage image{ target, target, TGAImage::RGBA };
+        runner.run("line", { param("length", length) }, BATCH, [&] {
+            for (const auto& l: lines) {
+                line(l[0], l[1], image, white);
+            }
+        });
+    }
+
+    const std::array<Vec3f, 3> tri{ Vec3f{ 10, 10, 0 }, Vec3f{ 500, 40, 0 }, Vec3f{ 200, 480, 0 } };
+    std::uniform_real_distribution<float> coord{ 0, 512 };
+    std::vector<Vec3f> points(BATCH);
+    for (auto& p: points) {
+        p = Vec3f{ coord(rng), coord(rng), 0 };
+    }
+    runner.run("barycentric", {}, BATCH, [&] {
+        for (const auto& p: points) {
+            keep(barycentric(tri, p));
+        }
+    });
+}
+
+void benchMatrices(BenchRunner& runner) {
+    const int count = 1024;
+    std::mt19937 rng{ 2 };
+    std::uniform_real_distribution<float> value{ -1, 1 };
+    std::vector<Mat4f> a(count), b(count), product(count);
+    std::vector<Vec4f> v(count), transformed(count);
+    std::vector<Matrix> ma(count), mb(count);
+    for (int n = 0; n < count; ++n) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                ma[n][i][j] = a[n][i][j] = value(rng);
+                mb[n][i][j] = b[n][i][j] = value(rng);
+            }
+        }
+        v[n] = Vec4f{ value(rng), value(rng), value(rng), 1 };
+    }
+
+    runner.run("Matrix::operator*", {}, count, [&] {
+        for (int n = 0; n < count; ++n) {
+            keep(ma[n] * mb[n]);
+        }
+    });
+    runner.run("Mat4f::operator*", { param("operand", "Mat4f") }, count, [&] {
+        for (int n = 0; n < count; ++n) {
+            product[n] = a[n] * b[n];
+        }
+        keep(product);
+    });
+    runner.run("Mat4f::operator*", { param("operand", "Vec4f") }, count, [&] {
+        for (int n = 0; n < count; ++n) {
+            transformed[n] = a[0] * v[n];
+        }
+        keep(transformed);
+    });
+}
+
+void benchTga(BenchRunner& runner, const std::string& texture, const fs::path& dir, ThreadPool& pool) {
+    TGAImage image;
+    if (!readTga(texture, image)) return;
+    const std::vector<Param> size{ param("width", image.get_width()), param("height", image.get_height()),
+                                   param("bpp", image.get_bytespp() * 8) };
+    const auto withRle = [&](bool rle) {
+        auto params = size;
+        params.push_back(param("rle", rle ? "yes" : "no"));
+        return params;
+    };
+
+    for (const auto rle: { true, false }) {
+        const auto file = (dir / (rle ? "bench-rle.tga" : "bench-raw.tga")).string();
+        runner.run("TGAImage::write_tga_file", withRle(rle), 1, [&] {
+            image.write_tga_file(file, true, rle);
+        });
+        TgaWriteOptions options;
+        options.rle = rle;
+        runner.run("writeTga", withRle(rle), 1, [&] {
+            writeTga(file, image, options, pool);
+        });
+        TGAImage read;
+        runner.run("TGAImage::read_tga_file", withRle(rle), 1, [&] {
+            QuietStderr quiet; // it prints the size of every image
+            read.read_tga_file(file);
+        });
+        runner.run("readTga", withRle(rle), 1, [&] {
+            readTga(file, read);
+        });
+    }
+}
+
+// Loads and renders file unless the filter excludes all of it, prepare() makes sure the file exists
+template <class Prepare>
+void benchModel(BenchRunner& runner, const std::string& name, const std::string& file, long faces,
+                const std::vector<int>& resolutions, ThreadPool& pool, Prepare&& prepare) {
+    const std::vector<Param> params{ param("mesh", name), param("triangles", faces) };
+    struct Frame {
+        std::vector<Param> params;
+        int resolution;
+        bool deferred;
+    };
+    std::vector<Frame> frames;
+    for (const auto resolution: resolutions) {
+        for (const auto deferred: { false, true }) {
+            auto frameParams = params;
+            frameParams.push_back(param("resolution", resolution));
+            frameParams.push_back(param("mode", deferred ? "visibility" : "forward"));
+            frameParams.push_back(param("threads", pool.size()));
+            if (runner.enabled("frame", frameParams)) {
+                frames.push_back(Frame{ std::move(frameParams), resolution, deferred });
+            }
+        }
+    }
+    if (frames.empty() && !runner.enabled("Model/obj", params) && !runner.enabled("Model/cache", params)) return;
+    if (!prepare()) return;
+
+    runner.run("Model/obj", params, 1, [&] {
+        keep(loadModel(file, pool, false));
+    });
+    // Also (re)builds the cache the mapped loads use
+    const auto model = loadModel(file, pool, true);
+    runner.run("Model/cache", params, 1, [&] {
+        keep(loadModel(file, pool, true));
+    });
+
+    for (const auto& frame: frames) {
+        FrameRenderer renderer{ frame.resolution, frame.resolution, frame.deferred, pool };
+        const auto transform = camera.transform(frame.resolution, frame.resolution);
+        runner.run("frame", frame.params, 1, [&] {
+            renderer.render(*model, transform, lightDir);
+        });
+    }
+}
+
+void usage(const char *name) {
+    std::cerr << "Usage: " << name << " [-o results.json] [--filter text] [--min-time seconds] [--runs N]\n"
+              << "       " << std::string(std::strlen(name), ' ') << " [-t threads] [--simd level] [--max-triangles N] [--work-dir dir] [model.obj]\n"
+              << "  -o, --output FILE    where the JSON results go, stdout by default\n"
+              << "  --filter TEXT        only run benchmarks whose name contains TEXT, e.g. frame/mesh:sphere\n"
+              << "  --min-time SECONDS   time every benchmark for at least this long, 0.5 by default\n"
+              << "  --runs N             and at least N runs, 5 by default\n"
+              << "  -t, --threads N      renderer threads, 0 uses every core (default)\n"
+              << "  --simd LEVEL         scalar, sse2 or avx2, defaults to the best the CPU has\n"
+              << "  --max-triangles N    largest synthetic mesh, 10000000 by default\n"
+              << "  --work-dir DIR       generated meshes, caches and images, kept for later runs, bench-data by default\n";
+}
+
+bool parseOptions(int argc, char **argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        if ((!std::strcmp(argv[i], "-o") || !std::strcmp(argv[i], "--output")) && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            options.minSeconds = std::stod(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--runs") && i + 1 < argc) {
+            options.minRuns = std::max(1, std::stoi(argv[++i]));
+        } else if ((!std::strcmp(argv[i], "-t") || !std::strcmp(argv[i], "--threads")) && i + 1 < argc) {
+            options.threads = std::stoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--simd") && i + 1 < argc) {
+            const std::string level{ argv[++i] };
+            setSimdLevel(level == "avx2" ? SimdLevel::AVX2 : level == "sse2" ? SimdLevel::SSE2 : SimdLevel::Scalar);
+        } else if (!std::strcmp(argv[i], "--max-triangles") && i + 1 < argc) {
+            options.maxTriangles = std::stol(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--work-dir") && i + 1 < argc) {
+            options.workDir = argv[++i];
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            options.model = argv[i];
+        }
+    }
+    return true;
+}
+
+std::string timestamp() {
+    const auto now = std::time(nullptr);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buf;
+}
+
+std::string compiler() {
+#if defined(__VERSION__)
+    return __VERSION__;
+#elif defined(_MSC_FULL_VER)
+    return "MSVC " + std::to_string(_MSC_FULL_VER);
+#else
+    return "unknown";
+#endif
+}
+
+}
+
+// Micro benchmarks of the rasterizer entry points, matrix products and TGA
+// I/O, then loading and rendering african_head and generated spheres of 1K to
+// 10M triangles at several resolutions. Progress goes to stderr, the results
+// as one JSON document to stdout or -o.
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::error_code error;
+    const fs::path dir{ options.workDir };
+    fs::create_directories(dir, error);
+    if (error) {
+        std::cerr << "can't create directory " << dir.string() << ": " << error.message() << "\n";
+        return 1;
+    }
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "can't open file " << options.output << "\n";
+            return 1;
+        }
+    }
+
+    // Work on copies, loading writes mesh caches next to the model
+    const fs::path model{ options.model };
+    const auto texture = model.parent_path() / (model.stem().string() + "_diffuse.tga");
+    const auto copy = dir / model.filename();
+    fs::copy_file(model, copy, fs::copy_options::update_existing, error);
+    if (error) {
+        std::cerr << "can't copy " << model.string() << ": " << error.message() << "\n";
+        return 1;
+    }
+    fs::copy_file(texture, dir / texture.filename(), fs::copy_options::update_existing, error);
+
+    ThreadPool pool{ options.threads };
+    BenchRunner runner{ options.minSeconds, options.minRuns, options.filter, std::cerr };
+    benchRasterizers(runner);
+    benchMatrices(runner);
+    benchTga(runner, texture.string(), dir, pool);
+
+    const std::vector<int> resolutions{ 512, 1024, 2048 };
+    const auto faces = loadModel(copy.string(), pool, true)->nfaces();
+    benchModel(runner, model.stem().string(), copy.string(), faces, resolutions, pool, [] { return true; });
+    for (long triangles = 1000; triangles <= options.maxTriangles; triangles *= 10) {
+        const auto name = "sphere-" + (triangles >= 1'000'000 ? std::to_string(triangles / 1'000'000) + "M"
+                                                              : std::to_string(triangles / 1000) + "K");
+        const auto obj = (dir / (name + ".obj")).string();
+        benchModel(runner, name, obj, sphereFaces(triangles), resolutions, pool, [&] {
+            if (fs::exists(obj)) return true;
+            std::cerr << "Generating " << obj << '\n';
+            return writeSphereObj(obj, triangles);
+        });
+    }
+
+    const std::vector<Param> context{ param("date", timestamp()), param("simd", simdName(simdLevel())),
+                                      param("threads", pool.size()), param("compiler", compiler()),
+                                      param("min_time", static_cast<long>(options.minSeconds * 1000)) };
+    runner.writeJson(options.output.empty() ? std::cout : file, context);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef MYRENDERER_BENCHMARK_H
+#define MYRENDERER_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Keeps the compiler from dropping a computation whose result is never read
+template <class T>
+inline void keep(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+// A benchmark parameter, the value already encoded as JSON
+using Param = std::pair<std::string, std::string>;
+
+inline std::string jsonString(const std::string& s) {
+    std::string res{ '"' };
+    for (const auto c: s) {
+        if (c == '"' || c == '\\') res += '\\';
+        res += c;
+    }
+    return res + '"';
+}
+
+inline Param param(const std::string& name, const std::string& value) { return { name, jsonString(value) }; }
+inline Param param(const std::string& name, const char *value) { return { name, jsonString(value) }; }
+inline Param param(const std::string& name, long value) { return { name, std::to_string(value) }; }
+
+struct BenchResult {
+    std::string name;
+    std::vector<Param> params;
+    long items;                  // units of work one run does, e.g. triangles or frames
+    std::vector<double> samples; // nanoseconds per item, one per run
+
+    [[nodiscard]] std::string fullName() const {
+        auto res = name;
+        for (const auto& p: params) {
+            res += '/' + p.first + ':' + (p.second.front() == '"' ? p.second.substr(1, p.second.size() - 2) : p.second);
+        }
+        return res;
+    }
+};
+
+// Times benchmark bodies and collects their results. Every body runs once to
+// warm up, then until both minRuns runs and minSeconds have passed.
+class BenchRunner {
+public:
+    BenchRunner(double minSeconds, int minRuns, std::string filter, std::ostream& log)
+        : mMinSeconds(minSeconds), mMinRuns(minRuns), mFilter(std::move(filter)), mLog(log) {}
+
+    [[nodiscard]] bool enabled(const std::string& name, const std::vector<Param>& params = {}) const {
+        return BenchResult{ name, params, 0, {} }.fullName().find(mFilter) != std::string::npos;
+    }
+
+    // body() does items units of work
+    template <class Body>
+    void run(const std::string& name, std::vector<Param> params, long items, Body&& body) {
+        BenchResult result{ name, std::move(params), items, {} };
+        if (result.fullName().find(mFilter) == std::string::npos) return;
+
+        using Clock = std::chrono::steady_clock;
+        body();
+        const auto start = Clock::now();
+        while (static_cast<int>(result.samples.size()) < mMinRuns ||
+               std::chrono::duration<double>(Clock::now() - start).count() < mMinSeconds) {
+            const auto runStart = Clock::now();
+            body();
+            const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - runStart).count();
+            result.samples.push_back(elapsed / items);
+        }
+        mLog << result.fullName() << ": " << median(result.samples) << " ns per item, "
+             << result.samples.size() << " runs\n";
+        mResults.push_back(std::move(result));
+    }
+
+    [[nodiscard]] const std::vector<BenchResult>& results() const { return mResults; }
+
+    // context are the top-level fields that describe the machine and build
+    void writeJson(std::ostream& out, const std::vector<Param>& context) const {
+        out << "{\n  \"context\": {";
+        for (std::size_t i = 0; i < context.size(); ++i) {
+            out << (i ? ", " : "") << jsonString(context[i].first) << ": " << context[i].second;
+        }
+        out << "},\n  \"benchmarks\": [\n";
+        for (std::size_t i = 0; i < mResults.size(); ++i) {
+            const auto& r = mResults[i];
+            auto sorted = r.samples;
+            std::sort(sorted.begin(), sorted.end());
+            auto mean = 0.;
+            for (const auto s: sorted) mean += s;
+            mean /= sorted.size();
+            auto variance = 0.;
+            for (const auto s: sorted) variance += (s - mean) * (s - mean);
+            const auto med = median(sorted);
+            out << "    {\"name\": " << jsonString(r.fullName()) << ", \"benchmark\": " << jsonString(r.name) << ", \"params\": {";
+            for (std::size_t j = 0; j < r.params.size(); ++j) {
+                out << (j ? ", " : "") << jsonString(r.params[j].first) << ": " << r.params[j].second;
+            }
+            out << "}, \"items\": " << r.items << ", \"runs\": " << sorted.size() << ", \"time_unit\": \"ns\""
+                << ", \"median\": " << med << ", \"min\": " << sorted.front() << ", \"mean\": " << mean
+                << ", \"stddev\": " << std::sqrt(variance / sorted.size())
+                << ", \"items_per_second\": " << (med > 0 ? 1e9 / med : 0.) << "}"
+                << (i + 1 < mResults.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+private:
+    static double median(std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        const auto n = samples.size();
+        return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    }
+
+    double mMinSeconds;
+    int mMinRuns;
+    std::string mFilter;
+    std::ostream& mLog;
+    std::vector<BenchResult> mResults;
+};
+
+#endif //MYRENDERER_BENCHMARK_H
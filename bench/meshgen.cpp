@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "meshgen.h"
+
+namespace {
+
+// Buffered text output through to_chars, printf is the bottleneck for 10M faces
+class ObjWriter {
+public:
+    explicit ObjWriter(std::FILE *file) : mFile(file) { mBuffer.reserve(BUFFER_SIZE + 256); }
+    ~ObjWriter() { flush(); }
+
+    ObjWriter& operator<<(const char *s) {
+        while (*s) mBuffer.push_back(*s++);
+        return *this;
+    }
+    ObjWriter& operator<<(char c) { mBuffer.push_back(c); return *this; }
+    template <class T>
+    ObjWriter& operator<<(T value) {
+        char tmp[32];
+        const auto res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        mBuffer.insert(mBuffer.end(), tmp, res.ptr);
+        if (mBuffer.size() >= BUFFER_SIZE) flush();
+        return *this;
+    }
+
+    bool flush() {
+        const auto ok = std::fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) == mBuffer.size();
+        mBuffer.clear();
+        mOk = mOk && ok;
+        return mOk;
+    }
+
+private:
+    static constexpr std::size_t BUFFER_SIZE = 1 << 20;
+
+    std::FILE *mFile;
+    std::vector<char> mBuffer;
+    bool mOk = true;
+};
+
+// rows x 2 rows quads, two triangles each
+long sphereRows(long triangles) {
+    return std::max(2L, std::lround(std::sqrt(triangles / 4.)));
+}
+
+}
+
+long sphereFaces(long triangles) {
+    const auto rows = sphereRows(triangles);
+    return rows * rows * 4;
+}
+
+bool writeSphereObj(const std::string& filename, long triangles) {
+    const std::unique_ptr<std::FILE, int (*)(std::FILE *)> file{ std::fopen(filename.c_str(), "wb"), std::fclose };
+    if (!file) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    const auto rows = sphereRows(triangles);
+    const auto cols = rows * 2;
+    const auto pi = 3.14159265358979f;
+
+    ObjWriter out{ file.get() };
+    out << "# bumpy sphere, " << rows * cols * 2 << " faces\n";
+    for (long i = 0; i <= rows; ++i) {
+        const auto theta = pi * i / rows;
+        for (long j = 0; j <= cols; ++j) {
+            const auto phi = 2 * pi * j / cols;
+            const auto r = .8f + .05f * std::sin(8 * theta) * std::sin(8 * phi);
+            out << "v " << r * std::sin(theta) * std::cos(phi) << ' ' << r * std::cos(theta) << ' '
+                << r * std::sin(theta) * std::sin(phi) << '\n';
+        }
+    }
+    for (long i = 0; i <= rows; ++i) {
+        for (long j = 0; j <= cols; ++j) {
+            out << "vt " << static_cast<float>(j) / cols << ' ' << 1.f - static_cast<float>(i) / rows << '\n';
+        }
+    }
+    // Counter-clockwise seen from outside, OBJ indices start at 1
+    for (long i = 0; i < rows; ++i) {
+        for (long j = 0; j < cols; ++j) {
+            const auto a = i * (cols + 1) + j + 1;
+            const auto b = a + cols + 1;
+            out << "f " << a << '/' << a << ' ' << a + 1 << '/' << a + 1 << ' ' << b << '/' << b << '\n';
+            out << "f " << a + 1 << '/' << a + 1 << ' ' << b + 1 << '/' << b + 1 << ' ' << b << '/' << b << '\n';
+        }
+    }
+    if (!out.flush()) {
+        std::cerr << "can't write file " << filename << "\n";
+        return false;
+    }
+    return true;
+}
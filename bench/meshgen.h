@@ -0,0 +1,13 @@
+#ifndef MYRENDERER_MESHGEN_H
+#define MYRENDERER_MESHGEN_H
+
+#include <string>
+
+// Faces of the sphere writeSphereObj makes for triangles
+long sphereFaces(long triangles);
+// Writes a bumpy sphere of about triangles faces as an OBJ file with uvs, a
+// latitude-longitude grid twice as wide as it is high. Normals are left to
+// the loader.
+bool writeSphereObj(const std::string& filename, long triangles);
+
+#endif //MYRENDERER_MESHGEN_H
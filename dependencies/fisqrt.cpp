@@ -1,15 +1,18 @@
+#include <cstdint>
+#include <cstring>
+
 #include "fisqrt.h"
 
 float Q_rsqrt( float number ) {
-    long i;
+    std::int32_t i;
     float x2, y;
     const float threehalfs = 1.5f;
 
     x2 = number * 0.5f;
     y  = number;
-    i  = * ( long * ) &y;                       // evil floating point bit level hacking
+    std::memcpy( &i, &y, sizeof( i ) );         // evil floating point bit level hacking, 32 bits on every data model
     i  = 0x5f3759df - ( i >> 1 );               // what the fuck?
-    y  = * ( float * ) &i;
+    std::memcpy( &y, &i, sizeof( y ) );
     y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
     y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
 
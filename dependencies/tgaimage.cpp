@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cstring>
@@ -31,7 +32,7 @@ bool TGAImage::read_tga_file(const std::string filename) {
         return false;
     }
     size_t nbytes = bytespp*width*height;
-    data = std::vector<std::uint8_t>(nbytes, 0);
+    data = Storage(nbytes, 0);
     if (3==header.datatypecode || 2==header.datatypecode) {
         in.read(reinterpret_cast<char *>(data.data()), nbytes);
         if (!in.good()) {
@@ -218,7 +219,7 @@ void TGAImage::set(int x, int y, const TGAColor &c) {
     memcpy(data.data()+(x+y*width)*bytespp, c.bgra, bytespp);
 }
 
-int TGAImage::get_bytespp() {
+int TGAImage::get_bytespp() const {
     return bytespp;
 }
 
@@ -232,28 +233,21 @@ int TGAImage::get_height() const {
 
 void TGAImage::flip_horizontally() {
     if (!data.size()) return;
-    int half = width>>1;
-    for (int i=0; i<half; i++) {
-        for (int j=0; j<height; j++) {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width-1-i, j);
-            set(i, j, c2);
-            set(width-1-i, j, c1);
-        }
+    // Swap pixels within each row, a row is walked while it is in cache
+    for (int j=0; j<height; j++) {
+        std::uint8_t *row = data.data() + j*width*bytespp;
+        for (int i=0, k=width-1; i<k; i++, k--)
+            std::swap_ranges(row+i*bytespp, row+(i+1)*bytespp, row+k*bytespp);
     }
 }
 
 void TGAImage::flip_vertically() {
     if (!data.size()) return;
     size_t bytes_per_line = width*bytespp;
-    std::vector<std::uint8_t> line(bytes_per_line, 0);
     int half = height>>1;
     for (int j=0; j<half; j++) {
-        size_t l1 = j*bytes_per_line;
-        size_t l2 = (height-1-j)*bytes_per_line;
-        std::copy(data.begin()+l1, data.begin()+l1+bytes_per_line, line.begin());
-        std::copy(data.begin()+l2, data.begin()+l2+bytes_per_line, data.begin()+l1);
-        std::copy(line.begin(), line.end(), data.begin()+l2);
+        auto l1 = data.begin()+j*bytes_per_line;
+        std::swap_ranges(l1, l1+bytes_per_line, data.begin()+(height-1-j)*bytes_per_line);
     }
 }
 
@@ -261,13 +255,17 @@ std::uint8_t *TGAImage::buffer() {
     return data.data();
 }
 
+const std::uint8_t *TGAImage::buffer() const {
+    return data.data();
+}
+
 void TGAImage::clear() {
-    data = std::vector<std::uint8_t>(width*height*bytespp, 0);
+    data = Storage(width*height*bytespp, 0);
 }
 
 void TGAImage::scale(int w, int h) {
     if (w<=0 || h<=0 || !data.size()) return;
-    std::vector<std::uint8_t> tdata(w*h*bytespp, 0);
+    Storage tdata(w*h*bytespp, 0);
     int nscanline = 0;
     int oscanline = 0;
     int erry = 0;
@@ -1,8 +1,10 @@
 #ifndef __IMAGE_H__
 #define __IMAGE_H__
 
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
+#include <new>
 #include <vector>
 
 #pragma pack(push,1)
@@ -45,9 +47,28 @@ struct TGAColor {
     }
 };
 
+// Pixel storage starts on a cache line, so framebuffers can hand it out as is
+// and fill it with aligned SIMD stores
+template <class T>
+struct AlignedAllocator {
+    static constexpr std::size_t ALIGNMENT = 64;
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <class U> AlignedAllocator(const AlignedAllocator<U>&) { }
+
+    T *allocate(const std::size_t n) { return static_cast<T *>(::operator new(n*sizeof(T), std::align_val_t{ALIGNMENT})); }
+    void deallocate(T *p, std::size_t) { ::operator delete(p, std::align_val_t{ALIGNMENT}); }
+
+    template <class U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
 class TGAImage {
+public:
+    using Storage = std::vector<std::uint8_t, AlignedAllocator<std::uint8_t>>;
 protected:
-    std::vector<std::uint8_t> data;
+    Storage data;
     int width;
     int height;
     int bytespp;
@@ -68,8 +89,9 @@ public:
     void set(const int x, const int y, const TGAColor &c);
     int get_width() const;
     int get_height() const;
-    int get_bytespp();
+    int get_bytespp() const;
     std::uint8_t *buffer();
+    const std::uint8_t *buffer() const;
     void clear();
 };
 
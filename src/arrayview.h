@@ -0,0 +1,29 @@
+#ifndef MYRENDERER_ARRAYVIEW_H
+#define MYRENDERER_ARRAYVIEW_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Non-owning read-only view of a contiguous array
+template <class T>
+class ArrayView {
+public:
+    constexpr ArrayView() = default;
+    constexpr ArrayView(const T *data, std::size_t size) : mData(data), mSize(size) {}
+    ArrayView(const std::vector<T>& v) : mData(v.data()), mSize(v.size()) {}
+
+    const T& operator[](std::size_t i) const { assert(i < mSize); return mData[i]; }
+
+    [[nodiscard]] constexpr const T* data()  const { return mData; }
+    [[nodiscard]] constexpr std::size_t size() const { return mSize; }
+    [[nodiscard]] constexpr bool empty() const { return mSize == 0; }
+    [[nodiscard]] constexpr const T* begin() const { return mData; }
+    [[nodiscard]] constexpr const T* end()   const { return mData + mSize; }
+
+private:
+    const T *mData = nullptr;
+    std::size_t mSize = 0;
+};
+
+#endif //MYRENDERER_ARRAYVIEW_H
@@ -0,0 +1,281 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "batch.h"
+#include "profiler.h"
+
+namespace {
+
+bool blankOrComment(const std::string& line) {
+    const auto first = line.find_first_not_of(" \t\r");
+    return first == std::string::npos || line[first] == '#';
+}
+
+bool parseVec3(const std::string& value, Vec3f& v) {
+    char tail;
+    return std::sscanf(value.c_str(), "%f,%f,%f%c", &v.x, &v.y, &v.z, &tail) == 3;
+}
+
+#ifndef _WIN32
+// One client of serveBatch(), closed once the last reply to it is sent and
+// serveBatch() let go of it
+class Connection {
+public:
+    explicit Connection(int fd) : mFd(fd) {}
+    ~Connection() { ::close(mFd); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    [[nodiscard]] int fd() const { return mFd; }
+    // Ends the read loop of the client, replies still go out
+    void stopReading() { ::shutdown(mFd, SHUT_RD); }
+
+    // Replies from different workers do not interleave, a client that went away is ignored
+    void reply(const std::string& line) {
+        const auto text = line + '\n';
+        std::lock_guard<std::mutex> lock{ mMutex };
+        for (std::size_t sent = 0; sent < text.size(); ) {
+            const auto n = ::write(mFd, text.data() + sent, text.size() - sent);
+            if (n <= 0) return;
+            sent += n;
+        }
+    }
+
+private:
+    int mFd;
+    std::mutex mMutex;
+};
+
+void serveClient(const std::shared_ptr<Connection>& connection, BatchRenderer& batch) {
+    std::string pending;
+    char buffer[4096];
+    for (;;) {
+        const auto n = ::read(connection->fd(), buffer, sizeof(buffer));
+        if (n <= 0) break;
+        pending.append(buffer, n);
+        std::size_t start = 0;
+        for (auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+            const auto line = pending.substr(start, end - start);
+            start = end + 1;
+            if (blankOrComment(line)) continue;
+            RenderJob job;
+            std::string error;
+            if (!parseRenderJob(line, job, error)) {
+                connection->reply("error " + error);
+                continue;
+            }
+            batch.submit(job, [connection](bool ok, const std::string& message) {
+                connection->reply((ok ? "ok " : "error ") + message);
+            });
+        }
+        pending.erase(0, start);
+    }
+}
+
+// A thread of serveBatch() reading the jobs of one client
+struct Client {
+    std::shared_ptr<Connection> connection;
+    std::thread thread;
+    std::atomic<bool> done{ false };
+};
+#endif
+
+}
+
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error) {
+    std::istringstream fields{ line };
+    std::string field;
+    while (fields >> field) {
+        const auto eq = field.find('=');
+        if (eq == std::string::npos) {
+            error = "expected key=value, got " + field;
+            return false;
+        }
+        const auto key = field.substr(0, eq);
+        const auto value = field.substr(eq + 1);
+        auto ok = true;
+        if (key == "model") {
+            job.model = value;
+        } else if (key == "output") {
+            job.output = value;
+        } else if (key == "size") {
+            char tail;
+            ok = std::sscanf(value.c_str(), "%dx%d%c", &job.width, &job.height, &tail) == 2 &&
+                 job.width > 0 && job.height > 0 && job.width <= 16384 && job.height <= 16384;
+        } else if (key == "eye") {
+            ok = parseVec3(value, job.camera.eye);
+        } else if (key == "center") {
+            ok = parseVec3(value, job.camera.center);
+        } else if (key == "mode") {
+            ok = value == "forward" || value == "visibility";
+            job.deferred = value == "visibility";
+        } else {
+            error = "unknown field " + key;
+            return false;
+        }
+        if (!ok) {
+            error = "bad " + key + " " + value;
+            return false;
+        }
+    }
+    if (job.model.empty() || job.output.empty()) {
+        error = "a job needs a model and an output";
+        return false;
+    }
+    return true;
+}
+
+BatchRenderer::BatchRenderer(const BatchOptions& options, const Vec3f& lightDir)
+    : mOptions(options), mLightDir(lightDir), mModels(options.modelBudget, options.useMeshCache),
+      mScheduler(options.threads) {
+    for (int i = 0; i < mScheduler.size(); ++i) {
+        mWorkers.push_back(std::make_unique<Worker>());
+    }
+}
+
+void BatchRenderer::submit(const RenderJob& job, Done done) {
+    mScheduler.submit([this, job, done = std::move(done)](int index) {
+        std::string message;
+        const auto ok = render(job, *mWorkers[index], message);
+        ++(ok ? mRendered : mFailed);
+        if (done) {
+            done(ok, message);
+        }
+    });
+}
+
+bool BatchRenderer::render(const RenderJob& job, Worker& worker, std::string& message) {
+    PROFILE_SCOPE("job");
+    auto model = mModels.acquire(job.model, worker.pool);
+    if (!model) {
+        message = "can't load " + job.model;
+        return false;
+    }
+    auto& renderer = worker.renderer;
+    if (!renderer || renderer->width() != job.width || renderer->height() != job.height || renderer->deferred() != job.deferred) {
+        renderer = std::make_unique<FrameRenderer>(job.width, job.height, job.deferred, worker.pool);
+    }
+    renderer->render(*model, job.camera.transform(job.width, job.height), mLightDir);
+    mModels.release(model);
+    if (!writeTga(job.output, renderer->frame().image(), mOptions.tga, worker.pool)) {
+        message = "can't write " + job.output;
+        return false;
+    }
+    message = job.output;
+    return true;
+}
+
+bool runBatch(const std::string& manifest, const BatchOptions& options, const Vec3f& lightDir) {
+    std::ifstream file;
+    auto *in = &std::cin;
+    if (manifest != "-") {
+        file.open(manifest);
+        if (!file) {
+            std::cerr << "can't open file " << manifest << "\n";
+            return false;
+        }
+        in = &file;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    BatchRenderer batch{ options, lightDir };
+    std::mutex log;
+    auto invalid = 0L;
+    std::string line;
+    // Jobs start while the manifest is still being read
+    for (long n = 1; std::getline(*in, line); ++n) {
+        if (blankOrComment(line)) continue;
+        RenderJob job;
+        std::string error;
+        if (!parseRenderJob(line, job, error)) {
+            std::cerr << manifest << ":" << n << ": " << error << "\n";
+            ++invalid;
+            continue;
+        }
+        batch.submit(job, [&, n](bool ok, const std::string& message) {
+            if (ok) return;
+            std::lock_guard<std::mutex> lock{ log };
+            std::cerr << manifest << ":" << n << ": " << message << "\n";
+        });
+    }
+    batch.wait();
+
+    const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const auto models = batch.modelStats();
+    std::cerr << "Rendered " << batch.rendered() << " jobs in " << elapsed << " ms (" << batch.rendered() * 1e3 / elapsed
+              << " jobs/s) on " << batch.workers() << " workers, " << batch.failed() + invalid << " failed; models loaded "
+              << models.loads << ", reused " << models.hits << ", evicted " << models.evictions << ", "
+              << models.bytes / 1e6 << " MB cached\n";
+    return invalid == 0 && batch.failed() == 0;
+}
+
+#ifdef _WIN32
+bool serveBatch(const std::string&, const BatchOptions&, const Vec3f&) {
+    std::cerr << "--listen not supported, there are no Unix sockets on this platform\n";
+    return false;
+}
+#else
+bool serveBatch(const std::string& path, const BatchOptions& options, const Vec3f& lightDir) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << path << "\n";
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+        std::cerr << "can't listen on " << path << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    BatchRenderer batch{ options, lightDir };
+    std::cerr << "Listening on " << path << " with " << batch.workers() << " workers\n";
+    std::list<Client> clients;
+    for (;;) {
+        const auto client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "accept failed on " << path << ": " << std::strerror(errno) << "\n";
+            break;
+        }
+        // Clients that hung up are joined while the next one connects
+        clients.remove_if([](Client& c) {
+            if (!c.done) return false;
+            c.thread.join();
+            return true;
+        });
+        auto& c = clients.emplace_back();
+        c.connection = std::make_shared<Connection>(client);
+        c.thread = std::thread{ [&c, &batch] {
+            serveClient(c.connection, batch);
+            c.done = true;
+        } };
+    }
+    // batch has to outlive the client threads and the replies of their jobs
+    for (auto& c: clients) {
+        c.connection->stopReading();
+        c.thread.join();
+    }
+    batch.wait();
+    ::close(fd);
+    return false;
+}
+#endif
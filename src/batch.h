@@ -0,0 +1,87 @@
+#ifndef MYRENDERER_BATCH_H
+#define MYRENDERER_BATCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camerapath.h"
+#include "framerenderer.h"
+#include "jobscheduler.h"
+#include "modelcache.h"
+#include "tgawriter.h"
+
+// One frame to render. A job is written as one line of key=value fields:
+//   model=head.obj output=head.tga [size=WxH] [eye=x,y,z] [center=x,y,z] [mode=forward|visibility]
+struct RenderJob {
+    std::string model;
+    std::string output;  // a TGA file
+    int width = 800;
+    int height = 800;
+    Camera camera{ Vec3f{ 1, 1, 3 }, Vec3f{ 0, 0, 0 } };
+    bool deferred = false;
+};
+
+// Fills job from a line, error says what is wrong when it returns false
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error);
+
+struct BatchOptions {
+    int threads = 0;                     // concurrent jobs, 0 is one per core
+    std::size_t modelBudget = 1u << 30;  // bytes of models kept while no job uses them
+    bool useMeshCache = true;
+    TgaWriteOptions tga;
+};
+
+// Renders jobs side by side, each on one thread, so small frames scale with
+// the cores where splitting a single frame would not. Every worker keeps its
+// FrameRenderer between jobs of the same size and mode, models come from a
+// ModelCache shared by all workers.
+class BatchRenderer {
+public:
+    // ok and a message naming the output or the error
+    using Done = std::function<void(bool ok, const std::string& message)>;
+
+    BatchRenderer(const BatchOptions& options, const Vec3f& lightDir);
+
+    // done is called on the worker thread once the job is written or failed
+    void submit(const RenderJob& job, Done done);
+    // Blocks until every submitted job is done
+    void wait() { mScheduler.wait(); }
+
+    [[nodiscard]] int workers() const { return mScheduler.size(); }
+    [[nodiscard]] long rendered() const { return mRendered; }
+    [[nodiscard]] long failed() const { return mFailed; }
+    [[nodiscard]] ModelCache::Stats modelStats() { return mModels.stats(); }
+
+private:
+    struct Worker {
+        ThreadPool pool{ 1 };
+        std::unique_ptr<FrameRenderer> renderer;
+    };
+
+    bool render(const RenderJob& job, Worker& worker, std::string& message);
+
+    BatchOptions mOptions;
+    Vec3f mLightDir;
+    ModelCache mModels;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<long> mRendered{ 0 };
+    std::atomic<long> mFailed{ 0 };
+    // Last member, its destructor finishes the jobs while the rest is alive
+    JobScheduler mScheduler;
+};
+
+// Renders the jobs of a manifest, one per line, "-" reads stdin. Blank lines
+// and lines starting with # are skipped. Returns false if any job failed.
+bool runBatch(const std::string& manifest, const BatchOptions& options, const Vec3f& lightDir);
+
+// Listens on a Unix socket at path. Every line a client sends is a job and is
+// answered with "ok <output>" or "error <reason>" once it is done, in
+// completion order. Runs until the process is stopped. Not available on
+// Windows, where it fails right away.
+bool serveBatch(const std::string& path, const BatchOptions& options, const Vec3f& lightDir);
+
+#endif //MYRENDERER_BATCH_H
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "bvh.h"
+#include "vertexstage.h"
+
+namespace {
+
+// Faces per leaf, a leaf is the unit of culling
+const int MAX_LEAF_FACES = 64;
+
+struct Builder {
+    const ObjMesh& mesh;
+    std::vector<Vec3f> centroids; // three times the centroid of every face
+    std::vector<int> order;       // faces in leaf order
+
+    BvhNode makeNode(int begin, int end) const {
+        const auto inf = std::numeric_limits<float>::max();
+        BvhNode node{ Vec3f{ inf, inf, inf }, begin, Vec3f{ -inf, -inf, -inf }, end - begin };
+        for (int i = begin; i < end; ++i) {
+            const auto *v = &mesh.vertIdx[order[i] * 3];
+            for (int j = 0; j < 3; ++j) {
+                const auto& p = mesh.verts[v[j]];
+                node.lo = Vec3f{ std::min(node.lo.x, p.x), std::min(node.lo.y, p.y), std::min(node.lo.z, p.z) };
+                node.hi = Vec3f{ std::max(node.hi.x, p.x), std::max(node.hi.y, p.y), std::max(node.hi.z, p.z) };
+            }
+        }
+        return node;
+    }
+
+    // Splits the faces of a leaf-sized node at the median centroid along the
+    // longest axis of the centroid bounds and appends the two children
+    void split(std::vector<BvhNode>& nodes, int idx) {
+        const auto begin = nodes[idx].first;
+        const auto end = begin + nodes[idx].count;
+        const auto inf = std::numeric_limits<float>::max();
+        Vec3f lo{ inf, inf, inf }, hi{ -inf, -inf, -inf };
+        for (int i = begin; i < end; ++i) {
+            const auto& c = centroids[order[i]];
+            lo = Vec3f{ std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z) };
+            hi = Vec3f{ std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z) };
+        }
+        const auto ext = hi - lo;
+        const auto axis = ext.x >= ext.y && ext.x >= ext.z ? 0 : ext.y >= ext.z ? 1 : 2;
+        const auto mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b) {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+        const auto left = static_cast<int>(nodes.size());
+        nodes.push_back(makeNode(begin, mid));
+        nodes.push_back(makeNode(mid, end));
+        nodes[idx].first = left;
+        nodes[idx].count = 0;
+    }
+
+    void build(std::vector<BvhNode>& nodes, int idx) {
+        if (nodes[idx].count <= MAX_LEAF_FACES) return;
+        split(nodes, idx);
+        const auto left = nodes[idx].first;
+        build(nodes, left);
+        build(nodes, left + 1);
+    }
+};
+
+// Faces under node idx, they are contiguous in leaf order
+int subtreeFaces(ArrayView<BvhNode> bvh, int idx) {
+    auto first = idx, last = idx;
+    while (!bvh[first].leaf()) first = bvh[first].first;
+    while (!bvh[last].leaf()) last = bvh[last].first + 1;
+    return bvh[last].first + bvh[last].count - bvh[first].first;
+}
+
+}
+
+std::vector<BvhNode> buildBvh(ObjMesh& mesh, ThreadPool& pool) {
+    const auto nfaces = mesh.nfaces();
+    if (nfaces == 0) return {};
+
+    Builder builder{ mesh, std::vector<Vec3f>(nfaces), std::vector<int>(nfaces) };
+    const auto batch = 1 << 14;
+    pool.parallelFor((nfaces + batch - 1) / batch, [&](int b) {
+        for (int f = b * batch; f < std::min(nfaces, (b + 1) * batch); ++f) {
+            const auto *v = &mesh.vertIdx[f * 3];
+            builder.centroids[f] = mesh.verts[v[0]] + mesh.verts[v[1]] + mesh.verts[v[2]];
+            builder.order[f] = f;
+        }
+    });
+
+    // Split breadth first until there are enough disjoint subtrees to keep the pool busy
+    std::vector<BvhNode> nodes{ builder.makeNode(0, nfaces) };
+    std::vector<int> pending{ 0 };
+    const auto target = static_cast<std::size_t>(pool.size() * 4);
+    while (!pending.empty() && pending.size() < target) {
+        std::vector<int> next;
+        for (const auto idx: pending) {
+            if (nodes[idx].count <= MAX_LEAF_FACES) continue;
+            builder.split(nodes, idx);
+            next.push_back(nodes[idx].first);
+            next.push_back(nodes[idx].first + 1);
+        }
+        pending.swap(next);
+    }
+
+    // Every subtree is built into its own array with its root at 0, then appended
+    std::vector<std::vector<BvhNode>> subtrees(pending.size());
+    pool.parallelFor(static_cast<int>(pending.size()), [&](int i) {
+        subtrees[i].push_back(nodes[pending[i]]);
+        builder.build(subtrees[i], 0);
+    });
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        const auto shift = static_cast<int>(nodes.size()) - 1;
+        for (std::size_t k = 0; k < subtrees[i].size(); ++k) {
+            auto node = subtrees[i][k];
+            if (!node.leaf()) node.first += shift;
+            if (k == 0) {
+                nodes[pending[i]] = node;
+            } else {
+                nodes.push_back(node);
+            }
+        }
+    }
+
+    // Faces in leaf order
+    auto permute = [&](std::vector<int>& stream) {
+        std::vector<int> sorted(stream.size());
+        pool.parallelFor((nfaces + batch - 1) / batch, [&](int b) {
+            for (int f = b * batch; f < std::min(nfaces, (b + 1) * batch); ++f) {
+                std::copy_n(&stream[builder.order[f] * 3], 3, &sorted[f * 3]);
+            }
+        });
+        stream.swap(sorted);
+    };
+    permute(mesh.vertIdx);
+    permute(mesh.uvIdx);
+    permute(mesh.normIdx);
+
+    // Vertices in first use order, unreferenced ones go last
+    const auto nverts = static_cast<int>(mesh.verts.size());
+    std::vector<int> remap(nverts, -1);
+    auto next = 0;
+    for (auto& v: mesh.vertIdx) {
+        if (remap[v] < 0) remap[v] = next++;
+        v = remap[v];
+    }
+    std::vector<Vec3f> verts(nverts);
+    for (int i = 0; i < nverts; ++i) {
+        verts[remap[i] < 0 ? next++ : remap[i]] = mesh.verts[i];
+    }
+    mesh.verts.swap(verts);
+    return nodes;
+}
+
+void cullBvh(ArrayView<BvhNode> bvh, const Mat4f& transform, const Rect& viewport,
+             std::vector<BvhCluster>& clusters, BvhStats& stats) {
+    if (bvh.empty()) return;
+    std::vector<int> stack{ 0 };
+    while (!stack.empty()) {
+        const auto idx = stack.back();
+        stack.pop_back();
+        const auto& node = bvh[idx];
+        ++stats.nodes;
+
+        auto codesAnd = static_cast<std::uint8_t>(0xff);
+        auto behind = false;
+        auto x0 = std::numeric_limits<float>::max(), y0 = x0;
+        auto x1 = -x0, y1 = -x0, zmax = -x0;
+        for (int c = 0; c < 8; ++c) {
+            const Vec4f corner{ c & 1 ? node.hi.x : node.lo.x, c & 2 ? node.hi.y : node.lo.y, c & 4 ? node.hi.z : node.lo.z, 1.f };
+            const auto p = transform * corner;
+            codesAnd &= computeClipCode(p.x, p.y, p.w, viewport);
+            behind = behind || p.w < NEAR_W;
+            const auto s = p.project();
+            x0 = std::min(x0, s.x);
+            y0 = std::min(y0, s.y);
+            x1 = std::max(x1, s.x);
+            y1 = std::max(y1, s.y);
+            zmax = std::max(zmax, s.z);
+        }
+        if (codesAnd & CLIP_FRUSTUM) {
+            stats.outside += node.leaf() ? node.count : subtreeFaces(bvh, idx);
+            continue;
+        }
+        if (!node.leaf()) {
+            // Right child first, so the left one is popped first and clusters stay in face order
+            stack.push_back(node.first + 1);
+            stack.push_back(node.first);
+            continue;
+        }
+
+        BvhCluster cluster{ node.first, node.count, Rect{ 0, 0, 0, 0 }, std::numeric_limits<float>::max() };
+        if (!behind) {
+            // Same slack as triangle setup, the depth planes are evaluated in float
+            cluster.rect = Rect{ std::max(viewport.x0, static_cast<int>(std::floor(x0))),
+                                 std::max(viewport.y0, static_cast<int>(std::floor(y0))),
+                                 std::min(viewport.x1, static_cast<int>(std::floor(x1)) + 1),
+                                 std::min(viewport.y1, static_cast<int>(std::floor(y1)) + 1) };
+            cluster.zmax = zmax + 1e-3f * (1.f + std::abs(zmax));
+        }
+        stats.faces += node.count;
+        clusters.push_back(cluster);
+    }
+}
+
+bool occluded(const BvhCluster& cluster, DepthBuffer& depth) {
+    const auto& r = cluster.rect;
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return false;
+    const auto B = DepthBuffer::BLOCK;
+    for (int by = r.y0 / B; by <= (r.y1 - 1) / B; ++by) {
+        for (int bx = r.x0 / B; bx <= (r.x1 - 1) / B; ++bx) {
+            if (depth.blockFar(bx, by) < cluster.zmax) return false;
+        }
+    }
+    return true;
+}
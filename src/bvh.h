@@ -0,0 +1,54 @@
+#ifndef MYRENDERER_BVH_H
+#define MYRENDERER_BVH_H
+
+#include <vector>
+
+#include "arrayview.h"
+#include "depthbuffer.h"
+#include "geometry.h"
+#include "objparser.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+// Axis-aligned box around a range of faces, in model space. Nodes are stored
+// root first and the two children of a node are always next to each other.
+struct BvhNode {
+    Vec3f lo;
+    int first;  // leaf: first face, inner node: index of the left child
+    Vec3f hi;
+    int count;  // faces in a leaf, 0 for inner nodes
+
+    [[nodiscard]] bool leaf() const { return count > 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode is stored as is in the mesh cache");
+
+// Leaf of the hierarchy that survived frustum culling, with its screen footprint
+struct BvhCluster {
+    int first;   // faces [first, first + count)
+    int count;
+    Rect rect;   // covered pixels, empty when the box reaches behind the near plane
+    float zmax;  // no face of the cluster gets a larger depth
+};
+
+struct BvhStats {
+    long nodes = 0;     // nodes visited
+    long faces = 0;     // faces in the clusters kept
+    long outside = 0;   // faces rejected by the frustum
+    long occluded = 0;  // faces rejected by the depth buffer
+};
+
+// Builds a median-split hierarchy over the faces of mesh. The index streams
+// are reordered so every leaf owns a contiguous run of faces, and vertices are
+// renumbered in the order the faces first use them, which keeps the vertices
+// of a leaf close together.
+std::vector<BvhNode> buildBvh(ObjMesh& mesh, ThreadPool& pool);
+
+// Appends the leaves of bvh that may be inside the view frustum of transform
+void cullBvh(ArrayView<BvhNode> bvh, const Mat4f& transform, const Rect& viewport,
+             std::vector<BvhCluster>& clusters, BvhStats& stats);
+
+// True when every 8x8 block under the cluster already holds closer depth than the cluster can reach
+bool occluded(const BvhCluster& cluster, DepthBuffer& depth);
+
+#endif //MYRENDERER_BVH_H
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "camerapath.h"
+
+namespace {
+
+const auto DEPTH = 255;
+constexpr float PI = 3.14159265358979f;
+
+}
+
+Mat4f lookAt(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
+    auto z = (eye - center).normalize();
+    auto x = (up^z).normalize();
+    auto y = (z^x).normalize();
+    auto res = Mat4f::identity();
+    for (int i = 0; i < 3; ++i) {
+        res[0][i] = x[i];
+        res[1][i] = y[i];
+        res[2][i] = z[i];
+        res[i][3] = -center[i];
+    }
+    return res;
+}
+
+Mat4f viewport(int x, int y, int w, int h) {
+    auto res = Mat4f::identity();
+    res[0][3] = x + w / 2.f;
+    res[1][3] = y + h / 2.f;
+    res[2][3] = DEPTH / 2.f;
+
+    res[0][0] = w / 2.f;
+    res[1][1] = h / 2.f;
+    res[2][2] = DEPTH / 2.f;
+    return res;
+}
+
+Mat4f Camera::modelView() const {
+    return lookAt(eye, center, Vec3f{0, 1, 0});
+}
+
+Mat4f Camera::projection() const {
+    auto res = Mat4f::identity();
+    res[3][2] = -1.f / (eye - center).norm();
+    return res;
+}
+
+Mat4f Camera::viewport(int width, int height) {
+    return ::viewport(width/8, height/8, width*3/4, height*3/4);
+}
+
+CameraPath CameraPath::orbit(const Camera& start) {
+    CameraPath path;
+    path.mKeys.push_back(start);
+    path.mOrbit = true;
+    return path;
+}
+
+bool CameraPath::loadKeyframes(const std::string& filename, CameraPath& path) {
+    std::ifstream in{ filename };
+    if (!in) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    std::vector<Camera> keys;
+    std::string line;
+    for (int n = 1; std::getline(in, line); ++n) {
+        std::istringstream fields{ line };
+        std::string first;
+        if (!(fields >> first) || first[0] == '#') continue;
+        fields.str(line);
+        fields.clear();
+        Camera key;
+        if (!(fields >> key.eye.x >> key.eye.y >> key.eye.z >> key.center.x >> key.center.y >> key.center.z)) {
+            std::cerr << filename << ":" << n << ": expected eye and center coordinates\n";
+            return false;
+        }
+        keys.push_back(key);
+    }
+    if (keys.empty()) {
+        std::cerr << "no keyframes in " << filename << "\n";
+        return false;
+    }
+    path.mKeys = std::move(keys);
+    path.mOrbit = false;
+    return true;
+}
+
+Camera CameraPath::at(int frame, int frames) const {
+    const auto& start = mKeys.front();
+    if (mOrbit) {
+        const auto angle = 2.f * PI * frame / std::max(frames, 1);
+        const auto c = std::cos(angle);
+        const auto s = std::sin(angle);
+        const auto d = start.eye - start.center;
+        return Camera{ start.center + Vec3f{ d.x * c + d.z * s, d.y, d.z * c - d.x * s }, start.center };
+    }
+    if (mKeys.size() == 1 || frames < 2) return start;
+    const auto t = static_cast<float>(frame) * (mKeys.size() - 1) / (frames - 1);
+    const auto i = std::min(static_cast<std::size_t>(t), mKeys.size() - 2);
+    const auto f = t - i;
+    const auto& a = mKeys[i];
+    const auto& b = mKeys[i + 1];
+    return Camera{ a.eye + (b.eye - a.eye) * f, a.center + (b.center - a.center) * f };
+}
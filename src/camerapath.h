@@ -0,0 +1,47 @@
+#ifndef MYRENDERER_CAMERAPATH_H
+#define MYRENDERER_CAMERAPATH_H
+
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+// Rotates into the frame looking from eye at center and subtracts center
+// afterwards, which puts center at the origin only when it already is there
+Mat4f lookAt(const Vec3f& eye, const Vec3f& center, const Vec3f& up);
+// Maps [-1, 1] to the pixels [x, x + w) x [y, y + h) and depth to [0, 255]
+Mat4f viewport(int x, int y, int w, int h);
+
+struct Camera {
+    Vec3f eye;
+    Vec3f center;
+
+    // Looking from eye at center with y up
+    [[nodiscard]] Mat4f modelView() const;
+    // Central projection with the eye at its distance to center
+    [[nodiscard]] Mat4f projection() const;
+    // Maps [-1, 1] to the middle 3/4 of a width x height frame and depth to [0, 255]
+    static Mat4f viewport(int width, int height);
+    [[nodiscard]] Mat4f transform(int width, int height) const { return viewport(width, height) * projection() * modelView(); }
+};
+
+// Where the camera is in each frame of an animation: either one turn around
+// the vertical axis through the center of a start camera, or a polyline
+// through keyframes spaced evenly over the frames.
+class CameraPath {
+public:
+    static CameraPath orbit(const Camera& start);
+    // One keyframe per line, "eye.x eye.y eye.z center.x center.y center.z",
+    // blank lines and lines starting with # are skipped
+    static bool loadKeyframes(const std::string& filename, CameraPath& path);
+
+    // Camera of frame [0, frames). An orbit ends one step short of the
+    // start so a looped turntable does not repeat a frame.
+    [[nodiscard]] Camera at(int frame, int frames) const;
+
+private:
+    std::vector<Camera> mKeys;
+    bool mOrbit = false;
+};
+
+#endif //MYRENDERER_CAMERAPATH_H
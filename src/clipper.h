@@ -0,0 +1,100 @@
+#ifndef MYRENDERER_CLIPPER_H
+#define MYRENDERER_CLIPPER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "geometry.h"
+#include "vertexstage.h"
+
+// Homogeneous clipping of the triangles primitive assembly and the shader
+// pipeline can't hand to triangle setup as they are. A corner carries M
+// floats, intensity and face weights or shader varyings, that are
+// interpolated linearly in clip space along with its position.
+template <int M>
+struct ClipVertex {
+    Vec4f p;
+    std::array<float, M> v;
+};
+
+// Inside where dot(p, plane) >= 0
+using ClipPlane = Vec4f;
+
+// A triangle clipped by at most five planes has no more than eight corners
+constexpr int MAX_CLIP_VERTS = 3 + 5;
+
+// Twice the signed screen area, positive for counter-clockwise corners
+inline float signedArea(const Vec3f& a, const Vec3f& b, const Vec3f& c) {
+    return (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+}
+
+inline float planeDistance(const Vec4f& p, const ClipPlane& plane) {
+    return p.x * plane.x + p.y * plane.y + p.z * plane.z + p.w * plane.w;
+}
+
+// Sutherland-Hodgman against one plane, returns the new vertex count
+template <int M>
+int clipPolygon(const ClipVertex<M> *in, int n, ClipVertex<M> *out, const ClipPlane& plane, float offset) {
+    auto count = 0;
+    for (int i = 0; i < n; ++i) {
+        const auto& a = in[i];
+        const auto& b = in[(i + 1) % n];
+        const auto da = planeDistance(a.p, plane) - offset;
+        const auto db = planeDistance(b.p, plane) - offset;
+        if (da >= 0) out[count++] = a;
+        if ((da >= 0) != (db >= 0)) {
+            const auto t = da / (da - db);
+            auto& v = out[count++];
+            v.p = a.p + (b.p - a.p) * t;
+            for (int k = 0; k < M; ++k) {
+                v.v[k] = a.v[k] + (b.v[k] - a.v[k]) * t;
+            }
+        }
+    }
+    return count;
+}
+
+// Clips the triangle corners against the planes in planes, the CLIP_NEEDED
+// bits of the corner clip codes or-ed together. The polygon left goes to out,
+// returns its vertex count, below 3 when nothing is left.
+template <int M>
+int clipTriangle(const ClipVertex<M> *corners, std::uint8_t planes, ClipVertex<M> *out) {
+    ClipVertex<M> buffers[2][MAX_CLIP_VERTS];
+    std::copy(corners, corners + 3, buffers[0]);
+    auto n = 3;
+    auto cur = 0;
+    const auto apply = [&](const ClipPlane& plane, float offset) {
+        if (n < 3) return;
+        n = clipPolygon(buffers[cur], n, buffers[cur ^ 1], plane, offset);
+        cur ^= 1;
+    };
+    if (planes & CLIP_NEAR) {
+        apply(ClipPlane{ 0, 0, 0, 1 }, NEAR_W);
+    }
+    if (planes & CLIP_GUARD) {
+        apply(ClipPlane{  1,  0, 0, CLIP_GUARD_BAND }, 0);
+        apply(ClipPlane{ -1,  0, 0, CLIP_GUARD_BAND }, 0);
+        apply(ClipPlane{  0,  1, 0, CLIP_GUARD_BAND }, 0);
+        apply(ClipPlane{  0, -1, 0, CLIP_GUARD_BAND }, 0);
+    }
+    std::copy(buffers[cur], buffers[cur] + n, out);
+    return n;
+}
+
+// Screen positions of the n corners of a clipped polygon, returns twice its
+// signed area. The polygon is planar, its winding is the winding of the
+// whole triangle.
+template <int M>
+float projectPolygon(const ClipVertex<M> *v, int n, Vec3f *screen) {
+    for (int i = 0; i < n; ++i) {
+        screen[i] = v[i].p.project();
+    }
+    auto area = 0.f;
+    for (int i = 1; i + 1 < n; ++i) {
+        area += signedArea(screen[0], screen[i], screen[i + 1]);
+    }
+    return area;
+}
+
+#endif //MYRENDERER_CLIPPER_H
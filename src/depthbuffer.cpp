@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <cstring>
+
+#include "depthbuffer.h"
+#include "simd.h"
+
+DepthBuffer::DepthBuffer(int width, int height) : mWidth(width), mHeight(height),
+                                                  mBlocksX((width + BLOCK - 1) / BLOCK),
+                                                  mBlocksY((height + BLOCK - 1) / BLOCK),
+                                                  mDepth(width * height, FAR),
+                                                  mFar(mBlocksX * mBlocksY, FAR),
+                                                  mDirty(mBlocksX * mBlocksY, 0) {
+}
+
+void DepthBuffer::clear() {
+    std::uint32_t far;
+    std::memcpy(&far, &FAR, sizeof(far));
+    fill32(mDepth.data(), mDepth.size(), far);
+    fill32(mFar.data(), mFar.size(), far);
+    std::memset(mDirty.data(), 0, mDirty.size());
+}
+
+Rect DepthBuffer::blockRect(int bx, int by) const {
+    return Rect{ bx * BLOCK, by * BLOCK, std::min((bx + 1) * BLOCK, mWidth), std::min((by + 1) * BLOCK, mHeight) };
+}
+
+float DepthBuffer::blockFar(int bx, int by) {
+    const auto idx = bx + by * mBlocksX;
+    if (mDirty[idx]) {
+        const auto r = blockRect(bx, by);
+        auto far = std::numeric_limits<float>::max();
+        for (int y = r.y0; y < r.y1; ++y) {
+            const auto *row = mDepth.data() + y * mWidth;
+            for (int x = r.x0; x < r.x1; ++x) {
+                far = std::min(far, row[x]);
+            }
+        }
+        mFar[idx] = far;
+        mDirty[idx] = 0;
+    }
+    return mFar[idx];
+}
@@ -0,0 +1,46 @@
+#ifndef MYRENDERER_DEPTHBUFFER_H
+#define MYRENDERER_DEPTHBUFFER_H
+
+#include <limits>
+#include <vector>
+
+#include "rasterizer.h"
+
+// Z-buffer with a second, coarse level holding the farthest depth of every
+// 8x8 block. Larger depth is closer, so nothing at depth z can pass in a
+// block whose farthest depth is already >= z. The coarse values are only
+// refreshed for blocks marked dirty, when they are asked for.
+class DepthBuffer {
+public:
+    static constexpr int BLOCK = 8;
+    static constexpr float FAR = -std::numeric_limits<float>::max();
+
+    DepthBuffer(int width, int height);
+
+    void clear();
+
+    [[nodiscard]] float* data() { return mDepth.data(); }
+    [[nodiscard]] const float* data() const { return mDepth.data(); }
+    [[nodiscard]] int width() const { return mWidth; }
+    [[nodiscard]] int height() const { return mHeight; }
+    [[nodiscard]] int blocksX() const { return mBlocksX; }
+    [[nodiscard]] int blocksY() const { return mBlocksY; }
+
+    // Farthest depth stored in block (bx, by)
+    [[nodiscard]] float blockFar(int bx, int by);
+    // Call after writing depth inside block (bx, by)
+    void markDirty(int bx, int by) { mDirty[bx + by * mBlocksX] = 1; }
+
+    [[nodiscard]] Rect blockRect(int bx, int by) const;
+
+private:
+    int mWidth;
+    int mHeight;
+    int mBlocksX;
+    int mBlocksY;
+    std::vector<float> mDepth;
+    std::vector<float> mFar;
+    std::vector<char> mDirty;
+};
+
+#endif //MYRENDERER_DEPTHBUFFER_H
@@ -0,0 +1,20 @@
+#include "framebuffer.h"
+#include "simd.h"
+
+Framebuffer::Framebuffer(int width, int height) : mWidth(width), mHeight(height), mImage(width, height, TGAImage::RGBA) {
+}
+
+void Framebuffer::resize(int width, int height) {
+    if (width == mWidth && height == mHeight) return;
+    mWidth = width;
+    mHeight = height;
+    mImage = TGAImage(width, height, TGAImage::RGBA);
+}
+
+void Framebuffer::clear(std::uint32_t bgra) {
+    fill32(data(), static_cast<std::size_t>(mWidth) * mHeight, bgra);
+}
+
+void Framebuffer::fillSpan(int x, int y, int count, std::uint32_t bgra) {
+    fill32(row(y) + x, count, bgra);
+}
@@ -0,0 +1,50 @@
+#ifndef MYRENDERER_FRAMEBUFFER_H
+#define MYRENDERER_FRAMEBUFFER_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "../dependencies/tgaimage.h"
+
+// Color target of the renderer: one packed 32-bit BGRA pixel per word, rows
+// without padding, starting on a 64 byte boundary. The storage is an RGBA
+// TGAImage, so image() exports a frame without copying it. Pixel and span
+// writes are not bounds checked, the rasterizer clips before writing.
+class Framebuffer {
+public:
+    static constexpr std::uint32_t OPAQUE = 0xff000000u;
+    static constexpr std::uint32_t BLACK = OPAQUE;
+
+    Framebuffer(int width, int height);
+
+    // Reallocates when the size changes, the contents are then transparent black
+    void resize(int width, int height);
+    void clear(std::uint32_t bgra = BLACK);
+
+    [[nodiscard]] int width() const { return mWidth; }
+    [[nodiscard]] int height() const { return mHeight; }
+    [[nodiscard]] std::uint32_t* data() { return reinterpret_cast<std::uint32_t *>(mImage.buffer()); }
+    [[nodiscard]] std::uint32_t* row(int y) { return data() + static_cast<std::size_t>(y) * mWidth; }
+
+    void set(int x, int y, std::uint32_t bgra) { row(y)[x] = bgra; }
+    void writeSpan(int x, int y, const std::uint32_t *pixels, int count) {
+        std::memcpy(row(y) + x, pixels, count * sizeof(std::uint32_t));
+    }
+    void fillSpan(int x, int y, int count, std::uint32_t bgra);
+
+    // The pixels as an RGBA image, valid until the next resize()
+    [[nodiscard]] TGAImage& image() { return mImage; }
+    [[nodiscard]] const TGAImage& image() const { return mImage; }
+
+    // Same byte order as TGAColor and the TGA file, b g r a from the lowest address
+    static std::uint32_t pack(const TGAColor& c) {
+        return c.bgra[0] | c.bgra[1] << 8 | c.bgra[2] << 16 | static_cast<std::uint32_t>(c.bgra[3]) << 24;
+    }
+
+private:
+    int mWidth;
+    int mHeight;
+    TGAImage mImage;
+};
+
+#endif //MYRENDERER_FRAMEBUFFER_H
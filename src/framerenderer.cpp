@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+
+#include "framerenderer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// What is left of a pixel's light in full shadow
+const auto UMBRA = .3f;
+
+std::uint32_t darken(std::uint32_t bgra, float f) {
+    auto res = bgra & Framebuffer::OPAQUE;
+    for (int shift = 0; shift < 24; shift += 8) {
+        res |= static_cast<std::uint32_t>(static_cast<float>(bgra >> shift & 0xff) * f + .5f) << shift;
+    }
+    return res;
+}
+
+}
+
+FrameRenderer::FrameRenderer(int width, int height, bool deferred, ThreadPool& pool, int samples)
+    : mPool(pool), mDeferred(deferred), mDepth(width, height), mFrame(width, height),
+      mRenderer(width, height, pool), mVertices(pool), mAssembly(mVertices, mRenderer),
+      mVisibility(deferred ? width : 0, deferred ? height : 0) {
+    assert(samples == 1 || (!deferred && isSampleCount(samples)));
+    if (samples > 1) {
+        // Same tiles as the renderer, so every tile's sample pool has one writer
+        mMsaa = std::make_unique<MsaaBuffer>(width, height, samples);
+        mRenderer.setSampleMargin(mMsaa->pattern().reach);
+    }
+}
+
+void FrameRenderer::draw(const Model& model, const Vec3f& lightDir, std::vector<BvhCluster>::const_iterator first,
+                         std::vector<BvhCluster>::const_iterator last) {
+    {
+        PROFILE_SCOPE("vertex transform");
+        for (auto c = first; c != last; ++c) {
+            mVertices.addFaces(c->first, c->count);
+        }
+        mVertices.flush();
+    }
+    {
+        PROFILE_SCOPE("primitive assembly");
+        for (auto c = first; c != last; ++c) {
+            for (int i = c->first; i < c->first + c->count; i++) {
+                const auto face = model.getFace(i);
+
+                std::array<int, 3> idx;
+                std::array<float, 3> intensities;
+                for (int j = 0; j < 3; j++) {
+                    idx[j] = face[j];
+                    intensities[j] = model.getNorm(i, j) * lightDir;
+                }
+                mAssembly.submit(i, idx, intensities);
+            }
+        }
+    }
+    const auto start = Clock::now();
+    {
+        PROFILE_SCOPE("raster");
+        if (mDeferred) {
+            mRenderer.renderVisibility(mVisibility.data(), mDepth);
+        } else if (mMsaa) {
+            mRenderer.renderMultisample(*mMsaa, mDepth);
+        } else {
+            mRenderer.render(mFrame, mDepth);
+        }
+    }
+    mTimes.raster += since(start);
+    mRasterized += mRenderer.ntriangles();
+    mRenderer.clear();
+}
+
+void FrameRenderer::beginFrame() {
+    mFrame.clear();
+    mDepth.clear();
+    if (mDeferred) {
+        mVisibility.clear();
+    }
+    if (mMsaa) {
+        mMsaa->clear();
+    }
+    mAssembly.clear();
+    mRenderer.resetStats();
+    mClusters.clear();
+    mTimes = Times{};
+    mBvhStats = BvhStats{};
+    mRasterized = 0;
+    mShaded = 0;
+}
+
+std::vector<BvhCluster>::iterator FrameRenderer::cull(const Model& model, const Mat4f& transform) {
+    PROFILE_SCOPE("cull");
+    const auto start = Clock::now();
+    cullBvh(model.bvh(), transform, Rect{ 0, 0, width(), height() }, mClusters, mBvhStats);
+    // Nearest first, the clusters drawn first leave the depth the others are tested against
+    std::stable_sort(mClusters.begin(), mClusters.end(), [](const BvhCluster& a, const BvhCluster& b) {
+        return a.zmax > b.zmax;
+    });
+    auto occluders = mClusters.begin();
+    for (long faces = 0; occluders != mClusters.end() && faces < mBvhStats.faces / 2; ++occluders) {
+        faces += occluders->count;
+    }
+    mTimes.cull = since(start);
+    return occluders;
+}
+
+void FrameRenderer::render(const Model& model, const Mat4f& transform, const Vec3f& lightDir) {
+    beginFrame();
+    auto occluders = cull(model, transform);
+
+    const auto start = Clock::now();
+    mVertices.begin(model, transform, Rect{ 0, 0, width(), height() });
+    // The nearest half of the faces are the occluders, the rest only gets drawn
+    // where the depth they left does not hide it
+    draw(model, lightDir, mClusters.begin(), occluders);
+    const auto visible = std::remove_if(occluders, mClusters.end(), [&](const BvhCluster& c) {
+        return occluded(c, mDepth) && (mBvhStats.occluded += c.count, true);
+    });
+    draw(model, lightDir, occluders, visible);
+    mTimes.geometry = since(start) - mTimes.raster;
+    mVertexStats = mVertices.stats();
+    mPrimitiveStats = mAssembly.stats();
+
+    if (mDeferred) {
+        PROFILE_SCOPE("shade");
+        const auto start = Clock::now();
+        mShaded = shadeVisibility(mVisibility, mAssembly.primitives(), model, lightDir, mFrame, mPool);
+        mTimes.shade = since(start);
+    } else if (mMsaa) {
+        const auto start = Clock::now();
+        mMsaa->resolve(mFrame, mPool);
+        mTimes.shade = since(start);
+    }
+    applyShadows(transform);
+    countFrame();
+}
+
+void FrameRenderer::applyShadows(const Mat4f& transform) {
+    if (!mShadowMap) return;
+    PROFILE_SCOPE("shadows");
+    const auto start = Clock::now();
+    // Pixel center and depth back into model space, then on into the map
+    const auto toMap = mShadowMap->transform() * transform.inverse();
+    mPool.parallelFor(height(), [&](int y) {
+        const auto *depth = mDepth.data() + static_cast<std::size_t>(y) * width();
+        auto *row = mFrame.row(y);
+        for (int x = 0; x < width(); ++x) {
+            if (depth[x] == DepthBuffer::FAR) continue;
+            const auto p = (toMap * Vec4f{ x + .5f, y + .5f, depth[x], 1.f }).project();
+            const auto lit = mShadowMap->lit(p, mPcf);
+            if (lit < 1.f) {
+                row[x] = darken(row[x], UMBRA + (1.f - UMBRA) * lit);
+            }
+        }
+    });
+    mTimes.shade += since(start);
+}
+
+void FrameRenderer::countFrame() const {
+    if (!profile::enabled()) return;
+    using profile::Counter;
+    profile::count(Counter::TrianglesSubmitted, mPrimitiveStats.triangles);
+    profile::count(Counter::TrianglesCulled, mPrimitiveStats.culled());
+    profile::count(Counter::TrianglesRasterized, mRasterized);
+    profile::count(Counter::FragmentsWritten, rasterStats().fragments);
+    // Every pixel something was drawn at holds a depth
+    const auto *depth = mDepth.data();
+    profile::count(Counter::PixelsCovered, std::count_if(depth, depth + static_cast<std::size_t>(width()) * height(),
+                                                         [](float z) { return z != DepthBuffer::FAR; }));
+}
+
+void FrameRenderer::render(const Model& model, const Camera& camera, ShaderKind kind, const Vec3f& lightDir) {
+    const auto transform = camera.transform(width(), height());
+    switch (kind) {
+        case ShaderKind::Gouraud:
+            render(model, transform, GouraudShader{ model, transform, lightDir });
+            break;
+        case ShaderKind::Textured:
+            render(model, transform, TexturedShader{ model, transform, lightDir });
+            break;
+        case ShaderKind::Phong:
+            render(model, transform, PhongShader{ model, transform, lightDir, camera.eye - camera.center });
+            break;
+    }
+}
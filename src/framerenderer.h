@@ -0,0 +1,183 @@
+#ifndef MYRENDERER_FRAMERENDERER_H
+#define MYRENDERER_FRAMERENDERER_H
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "bvh.h"
+#include "camerapath.h"
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "model.h"
+#include "msaa.h"
+#include "primitiveassembly.h"
+#include "profiler.h"
+#include "shaderpipeline.h"
+#include "shaders.h"
+#include "shadowmap.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+#include "vertexstage.h"
+#include "visibility.h"
+
+// Draws a model into a frame: BVH culling, then the nearest half of the
+// faces as occluders, then whatever of the rest the depth they left does not
+// hide. Forward mode shades while rasterizing, deferred mode fills a
+// visibility buffer and shades it afterwards, or a ShaderPipeline draws the
+// faces through a shader. Forward mode can also multisample, the samples are
+// resolved into the frame at the end. Shadows are applied last: every pixel's
+// depth is taken back into model space and looked up in a shadow map. All buffers are kept and only cleared from one
+// frame to the next.
+class FrameRenderer {
+public:
+    // Milliseconds spent on each stage of the last frame
+    struct Times {
+        double cull = 0;
+        double geometry = 0;  // vertex stage and primitive assembly
+        double raster = 0;
+        double shade = 0;     // deferred shading, the multisample resolve and shadows
+    };
+
+    // samples is 1 or, for forward rendering with render(model, transform, lightDir), 4 or 8
+    FrameRenderer(int width, int height, bool deferred, ThreadPool& pool, int samples = 1);
+    FrameRenderer(const FrameRenderer&) = delete;
+    FrameRenderer& operator=(const FrameRenderer&) = delete;
+
+    void render(const Model& model, const Mat4f& transform, const Vec3f& lightDir);
+    // Forward rendering with a user shader, transform is the one its vertex
+    // function applies and is only used for culling here
+    template <class Shader>
+    void render(const Model& model, const Mat4f& transform, const Shader& shader);
+    // One of the shipped shaders, seen through camera
+    void render(const Model& model, const Camera& camera, ShaderKind kind, const Vec3f& lightDir);
+
+    // Darkens the pixels map has in shadow, with pcf as in ShadowMap::lit().
+    // map must be drawn for the model rendered, nullptr turns shadows off.
+    void setShadows(const ShadowMap *map, int pcf = 0) { mShadowMap = map; mPcf = pcf; }
+    // Shader rendering first lays down the depth of every visible face with the
+    // depth-only rasterizer, then runs the fragment shader in one pass only
+    // where that depth is, once per pixel unless faces tie in depth
+    void setDepthPrepass(bool on) { mDepthPrepass = on; }
+
+    [[nodiscard]] int width() const { return mFrame.width(); }
+    [[nodiscard]] int height() const { return mFrame.height(); }
+    [[nodiscard]] bool deferred() const { return mDeferred; }
+    [[nodiscard]] int samples() const { return mMsaa ? mMsaa->pattern().count : 1; }
+    [[nodiscard]] Framebuffer& frame() { return mFrame; }
+    [[nodiscard]] const DepthBuffer& depth() const { return mDepth; }
+
+    // Statistics of the last frame
+    [[nodiscard]] const Times& times() const { return mTimes; }
+    [[nodiscard]] const BvhStats& bvhStats() const { return mBvhStats; }
+    [[nodiscard]] const VertexStage::Stats& vertexStats() const { return mVertexStats; }
+    [[nodiscard]] const PrimitiveAssembly::Stats& primitiveStats() const { return mPrimitiveStats; }
+    [[nodiscard]] const TileRenderer::Stats& rasterStats() const { return mRenderer.stats(); }
+    [[nodiscard]] int rasterized() const { return mRasterized; }
+    [[nodiscard]] int ntiles() const { return mRenderer.ntiles(); }
+    // Pixels shaded by the deferred pass or the shader, a depth prepass does not count
+    [[nodiscard]] long shaded() const { return mShaded; }
+    // Only when multisampling
+    [[nodiscard]] MsaaBuffer::Stats msaaStats() const { return mMsaa ? mMsaa->stats() : MsaaBuffer::Stats{}; }
+
+private:
+    void beginFrame();
+    // Fills mClusters nearest first and returns the end of the occluders, the
+    // clusters holding the nearest half of the faces
+    std::vector<BvhCluster>::iterator cull(const Model& model, const Mat4f& transform);
+    // Hands the stats of the frame to the profiler
+    void countFrame() const;
+    // transform is the one the frame was drawn with
+    void applyShadows(const Mat4f& transform);
+    void draw(const Model& model, const Vec3f& lightDir, std::vector<BvhCluster>::const_iterator first,
+              std::vector<BvhCluster>::const_iterator last);
+
+    ThreadPool& mPool;
+    bool mDeferred;
+    DepthBuffer mDepth;
+    Framebuffer mFrame;
+    TileRenderer mRenderer;
+    VertexStage mVertices;
+    PrimitiveAssembly mAssembly;
+    VisibilityBuffer mVisibility;
+    std::unique_ptr<MsaaBuffer> mMsaa;
+    std::vector<BvhCluster> mClusters;
+    const ShadowMap *mShadowMap = nullptr;
+    int mPcf = 0;
+    bool mDepthPrepass = false;
+
+    Times mTimes;
+    BvhStats mBvhStats;
+    VertexStage::Stats mVertexStats;
+    PrimitiveAssembly::Stats mPrimitiveStats;
+    int mRasterized = 0;
+    long mShaded = 0;
+};
+
+template <class Shader>
+void FrameRenderer::render(const Model& model, const Mat4f& transform, const Shader& shader) {
+    using Clock = std::chrono::steady_clock;
+    const auto since = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+    beginFrame();
+    auto occluders = cull(model, transform);
+
+    ShaderPipeline<Shader> pipeline{ mRenderer, Rect{ 0, 0, width(), height() } };
+    const auto submit = [&](std::vector<BvhCluster>::const_iterator first, std::vector<BvhCluster>::const_iterator last) {
+        const auto start = Clock::now();
+        const auto queued = mRenderer.ntriangles();
+        {
+            PROFILE_SCOPE("geometry");
+            for (auto c = first; c != last; ++c) {
+                pipeline.submit(shader, c->first, c->count);
+            }
+        }
+        mTimes.geometry += since(start);
+        mRasterized += mRenderer.ntriangles() - queued;
+    };
+    const auto prepass = [&] {
+        const auto start = Clock::now();
+        {
+            PROFILE_SCOPE("depth prepass");
+            pipeline.prepass(mDepth);
+        }
+        mTimes.raster += since(start);
+    };
+    const auto shade = [&] {
+        const auto start = Clock::now();
+        {
+            PROFILE_SCOPE("raster");
+            mShaded += pipeline.render(shader, mFrame, mDepth);
+        }
+        mTimes.raster += since(start);
+    };
+    // The rest is culled against the depth the occluders left
+    const auto visible = [&] {
+        return std::remove_if(occluders, mClusters.end(), [&](const BvhCluster& c) {
+            return occluded(c, mDepth) && (mBvhStats.occluded += c.count, true);
+        });
+    };
+    submit(mClusters.begin(), occluders);
+    if (mDepthPrepass) {
+        // Depth of both batches before the one shading pass, so the occluders
+        // are not shaded where the rest turns out to cover them
+        prepass();
+        submit(occluders, visible());
+        prepass();
+        shade();
+    } else {
+        shade();
+        submit(occluders, visible());
+        shade();
+    }
+
+    // Every corner goes through the vertex shader, nothing is shared
+    mVertexStats.transformed = mVertexStats.fetched = pipeline.stats().triangles * 3;
+    mPrimitiveStats = pipeline.stats();
+    applyShadows(transform);
+    countFrame();
+}
+
+#endif //MYRENDERER_FRAMERENDERER_H
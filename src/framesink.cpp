@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "framesink.h"
+#include "profiler.h"
+
+namespace {
+
+bool endsWith(const std::string& s, const char *suffix) {
+    const std::string tail{ suffix };
+    return s.size() >= tail.size() && s.compare(s.size() - tail.size(), tail.size(), tail) == 0;
+}
+
+// No conversion at all, or one %d with an optional zero flag and width
+bool isFramePattern(const std::string& name) {
+    const auto percent = name.find('%');
+    if (percent == std::string::npos) return true;
+    auto i = percent + 1;
+    while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i]))) ++i;
+    return i < name.size() && name[i] == 'd' && i - percent <= 4 && name.find('%', i) == std::string::npos;
+}
+
+std::string frameFileName(const std::string& pattern, long frame) {
+    if (pattern.find('%') == std::string::npos) return pattern;
+    // The pattern was checked to hold one int conversion, %ld takes the long
+    auto format = pattern;
+    format.insert(format.find('d', format.find('%')), "l");
+    std::vector<char> name(pattern.size() + 32);
+    std::snprintf(name.data(), name.size(), format.c_str(), frame);
+    return name.data();
+}
+
+}
+
+FrameSink::FrameSink() : mWriter([this] { writerLoop(); }) {}
+
+FrameSink::~FrameSink() {
+    close();
+}
+
+void FrameSink::writerLoop() {
+    using Clock = std::chrono::steady_clock;
+    profile::setThreadName("frame writer");
+    std::unique_lock<std::mutex> lock{ mMutex };
+    for (;;) {
+        mWake.wait(lock, [&] { return mPending || mStop; });
+        if (!mPending) return;
+        // submit() switched to the other image, this one stays untouched until we are done
+        const auto& image = mImages[mBack ^ 1];
+        const auto frame = mFrames - 1;
+        lock.unlock();
+        const auto start = Clock::now();
+        auto ok = false;
+        {
+            PROFILE_SCOPE("encode");
+            ok = encode(image, mBytes);
+        }
+        const auto encoded = Clock::now();
+        if (ok) {
+            PROFILE_SCOPE("write");
+            ok = output(frame, mBytes);
+            if (ok) profile::count(profile::Counter::BytesWritten, mBytes.size());
+        }
+        const auto written = Clock::now();
+        lock.lock();
+        mStats.encode += std::chrono::duration<double, std::milli>(encoded - start).count();
+        mStats.write += std::chrono::duration<double, std::milli>(written - encoded).count();
+        mFailed = mFailed || !ok;
+        mPending = false;
+        mDone.notify_all();
+    }
+}
+
+bool FrameSink::submit(const TGAImage& image) {
+    using Clock = std::chrono::steady_clock;
+    // Copying overlaps the write of the previous frame, the storage of the copy is reused
+    PROFILE_SCOPE("submit");
+    const auto start = Clock::now();
+    mImages[mBack] = image;
+    const auto copied = Clock::now();
+    {
+        std::unique_lock<std::mutex> lock{ mMutex };
+        mDone.wait(lock, [&] { return !mPending; });
+        mStats.copy += std::chrono::duration<double, std::milli>(copied - start).count();
+        mStats.stall += std::chrono::duration<double, std::milli>(Clock::now() - copied).count();
+        if (mFailed) return false;
+        mPending = true;
+        mBack ^= 1;
+        ++mFrames;
+    }
+    mWake.notify_one();
+    return true;
+}
+
+bool FrameSink::finish() {
+    std::unique_lock<std::mutex> lock{ mMutex };
+    mDone.wait(lock, [&] { return !mPending; });
+    return !mFailed;
+}
+
+FrameSink::Stats FrameSink::stats() {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mStats;
+}
+
+void FrameSink::close() {
+    finish();
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mStop = true;
+    }
+    mWake.notify_one();
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+bool TgaSink::encode(const TGAImage& image, std::vector<std::uint8_t>& out) {
+    out = encodeTga(image.buffer(), image.get_width(), image.get_height(), image.get_bytespp(), mOptions, mPool);
+    if (out.empty()) {
+        std::cerr << "can't encode a " << image.get_width() << "x" << image.get_height() << "/" << image.get_bytespp() * 8 << " image\n";
+        return false;
+    }
+    return true;
+}
+
+bool TgaSink::output(long frame, const std::vector<std::uint8_t>& bytes) {
+    const auto filename = frameFileName(mFilename, frame);
+    auto *out = std::fopen(filename.c_str(), "wb");
+    if (!out) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    std::setvbuf(out, nullptr, _IONBF, 0);
+    const auto written = std::fwrite(bytes.data(), 1, bytes.size(), out);
+    if (std::fclose(out) != 0 || written != bytes.size()) {
+        std::cerr << "can't dump the tga file " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+StreamSink::StreamSink(const std::string& path, StreamFormat format, bool vflip)
+    : mPath(path), mFormat(format), mVflip(vflip) {
+    mOut = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+    if (!mOut) {
+        std::cerr << "can't open file " << path << "\n";
+        return;
+    }
+#ifdef _WIN32
+    // stdout is opened in text mode there and would turn every 0x0a of a frame into 0x0d 0x0a
+    if (mOut == stdout) {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+    // Frames are large, each goes to the OS in one write
+    std::setvbuf(mOut, nullptr, _IONBF, 0);
+}
+
+StreamSink::~StreamSink() {
+    close();
+    if (mOut && mOut != stdout) {
+        std::fclose(mOut);
+    }
+}
+
+bool StreamSink::encode(const TGAImage& image, std::vector<std::uint8_t>& out) {
+    const auto width = image.get_width();
+    const auto height = image.get_height();
+    const auto bpp = image.get_bytespp();
+    if (width <= 0 || height <= 0 || (bpp != TGAImage::GRAYSCALE && bpp != TGAImage::RGB && bpp != TGAImage::RGBA)) {
+        std::cerr << "can't stream a " << width << "x" << height << "/" << bpp * 8 << " image\n";
+        return false;
+    }
+    const auto header = mFormat == StreamFormat::Ppm
+                        ? "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n"
+                        : std::string{};
+    const auto rowBytes = static_cast<std::size_t>(width) * 3;
+    out.resize(header.size() + rowBytes * height);
+    std::copy(header.begin(), header.end(), out.begin());
+
+    auto *rgb = out.data() + header.size();
+    const auto *pixels = image.buffer();
+    for (int y = 0; y < height; ++y) {
+        const auto *src = pixels + static_cast<std::size_t>(mVflip ? height - 1 - y : y) * width * bpp;
+        auto *dst = rgb + y * rowBytes;
+        if (bpp == TGAImage::GRAYSCALE) {
+            for (int x = 0; x < width; ++x, dst += 3) {
+                dst[0] = dst[1] = dst[2] = src[x];
+            }
+            continue;
+        }
+        for (int x = 0; x < width; ++x, src += bpp, dst += 3) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+        }
+    }
+    return true;
+}
+
+bool StreamSink::output(long frame, const std::vector<std::uint8_t>& bytes) {
+    if (std::fwrite(bytes.data(), 1, bytes.size(), mOut) != bytes.size() || std::fflush(mOut) != 0) {
+        std::cerr << "can't write frame " << frame << " to " << mPath << "\n";
+        return false;
+    }
+    return true;
+}
+
+FrameFormat frameFormatOf(const std::string& path) {
+    if (path == "-" || endsWith(path, ".ppm")) return FrameFormat::Ppm;
+    if (endsWith(path, ".rgb") || endsWith(path, ".raw")) return FrameFormat::Raw;
+    return FrameFormat::Tga;
+}
+
+std::unique_ptr<FrameSink> openFrameSink(const std::string& path, FrameFormat format, const TgaWriteOptions& tgaOptions) {
+    if (format == FrameFormat::Tga) {
+        if (!isFramePattern(path)) {
+            std::cerr << "bad frame name " << path << ", only a single %d is allowed\n";
+            return nullptr;
+        }
+        return std::make_unique<TgaSink>(path, tgaOptions);
+    }
+    auto sink = std::make_unique<StreamSink>(path, format == FrameFormat::Ppm ? StreamFormat::Ppm : StreamFormat::Raw);
+    if (!sink->isOpen()) return nullptr;
+    return sink;
+}
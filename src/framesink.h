@@ -0,0 +1,129 @@
+#ifndef MYRENDERER_FRAMESINK_H
+#define MYRENDERER_FRAMESINK_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "threadpool.h"
+#include "tgawriter.h"
+#include "../dependencies/tgaimage.h"
+
+// Destination of finished frames. submit() copies a frame into one of two
+// images and hands it to the sink's writer thread, which encodes and writes
+// it, so the caller can render the next frame into the same image meanwhile.
+// At most one frame is in flight, the next submit() waits for it.
+//
+// Subclasses must call close() in their destructor, the writer thread calls
+// their encode() and output().
+class FrameSink {
+public:
+    // Milliseconds summed over all frames
+    struct Stats {
+        double copy = 0;    // submit() copying frames, on the calling thread
+        double stall = 0;   // submit() waiting for the previous frame to be written
+        double encode = 0;  // on the writer thread
+        double write = 0;
+    };
+
+    FrameSink();
+    virtual ~FrameSink();
+    FrameSink(const FrameSink&) = delete;
+    FrameSink& operator=(const FrameSink&) = delete;
+
+    // False when an earlier frame could not be encoded or written
+    bool submit(const TGAImage& image);
+    // Waits until everything submitted is written, false if anything failed
+    bool finish();
+
+    [[nodiscard]] long frames() const { return mFrames; }
+    [[nodiscard]] Stats stats();
+
+protected:
+    // Turns image into the bytes output() gets
+    virtual bool encode(const TGAImage& image, std::vector<std::uint8_t>& out) = 0;
+    // Writes the bytes of frame number frame
+    virtual bool output(long frame, const std::vector<std::uint8_t>& bytes) = 0;
+
+    // finish() and stop the writer thread
+    void close();
+
+private:
+    void writerLoop();
+
+    TGAImage mImages[2];
+    int mBack = 0;       // image the next frame is copied into
+    long mFrames = 0;    // frames submitted
+    std::vector<std::uint8_t> mBytes;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    bool mPending = false;
+    bool mFailed = false;
+    bool mStop = false;
+    Stats mStats;
+    std::thread mWriter;
+};
+
+// Every frame as a TGA file. A filename with a printf-style %d, e.g.
+// frame%04d.tga, gets the frame number, otherwise each frame overwrites the
+// last one.
+class TgaSink final : public FrameSink {
+public:
+    TgaSink(std::string filename, const TgaWriteOptions& options)
+        : mFilename(std::move(filename)), mOptions(options) {}
+    ~TgaSink() override { close(); }
+
+protected:
+    bool encode(const TGAImage& image, std::vector<std::uint8_t>& out) override;
+    bool output(long frame, const std::vector<std::uint8_t>& bytes) override;
+
+private:
+    std::string mFilename;
+    TgaWriteOptions mOptions;
+    // The render threads are busy with the next frame, encoding stays on the writer thread
+    ThreadPool mPool{ 1 };
+};
+
+enum class StreamFormat {
+    Raw,  // bare rgb24 frames, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH
+    Ppm,  // a binary P6 image per frame, e.g. for ffmpeg -f image2pipe -c:v ppm
+};
+
+// Frames as 8-bit RGB, top row first, appended to one stream: stdout for
+// "-", otherwise a file or a FIFO that an encoder reads from. Opening a FIFO
+// blocks until its reader is there.
+class StreamSink final : public FrameSink {
+public:
+    // vflip as in TgaWriteOptions: row 0 of the submitted images is the bottom one
+    StreamSink(const std::string& path, StreamFormat format, bool vflip = true);
+    ~StreamSink() override;
+
+    [[nodiscard]] bool isOpen() const { return mOut != nullptr; }
+
+protected:
+    bool encode(const TGAImage& image, std::vector<std::uint8_t>& out) override;
+    bool output(long frame, const std::vector<std::uint8_t>& bytes) override;
+
+private:
+    std::string mPath;
+    StreamFormat mFormat;
+    bool mVflip;
+    std::FILE *mOut = nullptr;
+};
+
+enum class FrameFormat { Tga, Ppm, Raw };
+
+// Tga unless path is "-" or ends in .ppm, .rgb or .raw
+FrameFormat frameFormatOf(const std::string& path);
+
+// nullptr when the output cannot be opened or a TGA name pattern is malformed
+std::unique_ptr<FrameSink> openFrameSink(const std::string& path, FrameFormat format, const TgaWriteOptions& tgaOptions);
+
+#endif //MYRENDERER_FRAMESINK_H
@@ -1,3 +1,6 @@
+#include <cmath>
+#include <utility>
+
 #include "geometry.h"
 
 template <> template <> Vec3<int>::Vec3(const Vec3<float>& v) : x(static_cast<int>(v.x+.5)),
@@ -60,3 +63,51 @@ std::ostream& operator<<(std::ostream &s, const Matrix& m) {
     }
     return s;
 }
+
+Mat4f Mat4f::inverse() const {
+    // Row reduce [this | identity] in double, the right half ends up the inverse
+    double a[4][8];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            a[i][j] = m[i][j];
+            a[i][j + 4] = i == j ? 1. : 0.;
+        }
+    }
+    for (int col = 0; col < 4; ++col) {
+        auto pivot = col;
+        for (int i = col + 1; i < 4; ++i) {
+            if (std::abs(a[i][col]) > std::abs(a[pivot][col])) pivot = i;
+        }
+        if (a[pivot][col] == 0.) return Mat4f{};
+        std::swap(a[col], a[pivot]);
+        const auto inv = 1. / a[col][col];
+        for (auto& v: a[col]) {
+            v *= inv;
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (i == col) continue;
+            const auto f = a[i][col];
+            for (int j = 0; j < 8; ++j) {
+                a[i][j] -= f * a[col][j];
+            }
+        }
+    }
+    Mat4f res;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            res.m[i][j] = static_cast<float>(a[i][j + 4]);
+        }
+    }
+    return res;
+}
+
+std::ostream& operator<<(std::ostream &s, const Mat4f& mat) {
+    for (int i = 0; i < 4; ++i) {
+        s << "| ";
+        for (int j = 0; j < 4; ++j) {
+            s << mat.m[i][j] << ' ';
+        }
+        s << "|\n";
+    }
+    return s;
+}
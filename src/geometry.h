@@ -21,7 +21,7 @@ struct Vec2 {
         return *this;
     }
 
-    T& operator[](const int i) { assert(i >= 0 && i < 2); if (x==0) return x; else return y; }
+    T& operator[](const int i) { assert(i >= 0 && i < 2); if (i==0) return x; else return y; }
     Vec2<T> operator+(const Vec2<T>& V) const { return Vec2<T>{ x+V.x, y+V.y }; }
     Vec2<T> operator-(const Vec2<T>& V) const { return Vec2<T>{ x-V.x, y-V.y }; }
     Vec2<T> operator*(float f)          const { return Vec2<T>{ static_cast<T>(x*f), static_cast<T>(y*f) }; }
@@ -48,6 +48,7 @@ struct Vec3 {
     }
 
     T& operator[](const int i) { assert(i >=0 && i < 3); if (i==0) return x; else if (i==1) return y; else return z; }
+    T  operator[](const int i) const { assert(i >=0 && i < 3); return i==0 ? x : i==1 ? y : z; }
 
     Vec3<T> operator^(const Vec3<T>& v) const { return Vec3<T>{ y*v.z-z*v.y, z*v.x-x*v.z, x*v.y-y*v.x }; }
     Vec3<T> operator+(const Vec3<T>& v) const { return Vec3<T>{ x+v.x, y+v.y, z+v.z }; }
@@ -64,10 +65,30 @@ struct Vec3 {
     }
 };
 
+template <class T>
+struct Vec4 {
+    T x, y, z, w;
+
+    constexpr Vec4<T>() : x(T()), y(T()), z(T()), w(T()) {}
+    constexpr Vec4<T>(T _x, T _y, T _z, T _w) : x(_x), y(_y), z(_z), w(_w) {}
+    Vec4<T>(const Vec3<T>& v, T _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+    constexpr T& operator[](const int i) { assert(i >= 0 && i < 4); return i==0 ? x : i==1 ? y : i==2 ? z : w; }
+    constexpr T  operator[](const int i) const { assert(i >= 0 && i < 4); return i==0 ? x : i==1 ? y : i==2 ? z : w; }
+
+    constexpr Vec4<T> operator+(const Vec4<T>& v) const { return Vec4<T>{ x+v.x, y+v.y, z+v.z, w+v.w }; }
+    constexpr Vec4<T> operator-(const Vec4<T>& v) const { return Vec4<T>{ x-v.x, y-v.y, z-v.z, w-v.w }; }
+    constexpr Vec4<T> operator*(T f)          const { return Vec4<T>{ x*f, y*f, z*f, w*f }; }
+
+    // Perspective divide
+    [[nodiscard]] Vec3<T> project() const { return Vec3<T>{ x/w, y/w, z/w }; }
+};
+
 using Vec2f = Vec2<float>;
 using Vec2i = Vec2<int>;
 using Vec3f = Vec3<float>;
 using Vec3i = Vec3<int>;
+using Vec4f = Vec4<float>;
 
 template <> template <> Vec3<int>::Vec3(const Vec3<float> &v);
 template <> template <> Vec3<float>::Vec3(const Vec3<int> &v);
@@ -75,6 +96,56 @@ template <> template <> Vec3<float>::Vec3(const Vec3<int> &v);
 
 ///////////////////
 
+// 4x4 transform stored inline (row-major), unlike Matrix it never touches the heap
+struct alignas(16) Mat4f {
+    float m[4][4]{};
+
+    static constexpr Mat4f identity() {
+        Mat4f res;
+        for (int i = 0; i < 4; ++i) {
+            res.m[i][i] = 1.f;
+        }
+        return res;
+    }
+
+    constexpr float*       operator[](const int i)       { assert(i >= 0 && i < 4); return m[i]; }
+    constexpr const float* operator[](const int i) const { assert(i >= 0 && i < 4); return m[i]; }
+
+    constexpr Mat4f operator*(const Mat4f& o) const {
+        Mat4f res;
+        for (int i = 0; i < 4; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                for (int j = 0; j < 4; ++j) {
+                    res.m[i][j] += m[i][k] * o.m[k][j];
+                }
+            }
+        }
+        return res;
+    }
+
+    constexpr Vec4f operator*(const Vec4f& v) const {
+        return Vec4f{ m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z + m[0][3]*v.w,
+                      m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z + m[1][3]*v.w,
+                      m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z + m[2][3]*v.w,
+                      m[3][0]*v.x + m[3][1]*v.y + m[3][2]*v.z + m[3][3]*v.w };
+    }
+
+    [[nodiscard]] constexpr Mat4f transpose() const {
+        Mat4f res;
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                res.m[j][i] = m[i][j];
+            }
+        }
+        return res;
+    }
+
+    // Gauss-Jordan with partial pivoting, a singular matrix gives zeros
+    [[nodiscard]] Mat4f inverse() const;
+
+    friend std::ostream& operator<<(std::ostream& s, const Mat4f& mat);
+};
+
 const int DEFAULT_SIZE = 4;
 
 class Matrix {
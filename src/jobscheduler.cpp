@@ -0,0 +1,108 @@
+#include <algorithm>
+
+#include "jobscheduler.h"
+#include "profiler.h"
+
+namespace {
+
+// Worker index of the calling thread, -1 outside the workers
+thread_local int currentWorker = -1;
+
+}
+
+JobScheduler::JobScheduler(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threads; ++i) {
+        mQueues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < threads; ++i) {
+        mThreads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+JobScheduler::~JobScheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto& thread: mThreads) {
+        thread.join();
+    }
+}
+
+void JobScheduler::submit(Job job) {
+    auto index = currentWorker;
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        ++mUnfinished;
+        if (index < 0) {
+            index = static_cast<int>(mNextQueue++ % mQueues.size());
+        }
+    }
+    {
+        auto& queue = *mQueues[index];
+        std::lock_guard<std::mutex> lock{ queue.mutex };
+        queue.jobs.push_back(std::move(job));
+    }
+    // Only announced once it is in a deque, so a claimed job can always be found
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        ++mAvailable;
+    }
+    mWake.notify_one();
+}
+
+void JobScheduler::wait() {
+    std::unique_lock<std::mutex> lock{ mMutex };
+    mIdle.wait(lock, [&] { return mUnfinished == 0; });
+}
+
+JobScheduler::Job JobScheduler::take(int index) {
+    // The caller claimed a job, so at least one is queued somewhere. A pass
+    // can miss it while other workers move around, then it simply looks again.
+    for (;;) {
+        {
+            auto& own = *mQueues[index];
+            std::lock_guard<std::mutex> lock{ own.mutex };
+            if (!own.jobs.empty()) {
+                auto job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return job;
+            }
+        }
+        for (std::size_t i = 1; i < mQueues.size(); ++i) {
+            auto& victim = *mQueues[(index + i) % mQueues.size()];
+            std::lock_guard<std::mutex> lock{ victim.mutex };
+            if (!victim.jobs.empty()) {
+                auto job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return job;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void JobScheduler::workerLoop(int index) {
+    currentWorker = index;
+    profile::setThreadName("batch worker " + std::to_string(index));
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mWake.wait(lock, [&] { return mAvailable > 0 || mStop; });
+            if (mAvailable == 0) return;
+            --mAvailable;
+        }
+        take(index)(index);
+        {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            if (--mUnfinished == 0) {
+                mIdle.notify_all();
+            }
+        }
+    }
+}
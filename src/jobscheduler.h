@@ -0,0 +1,57 @@
+#ifndef MYRENDERER_JOBSCHEDULER_H
+#define MYRENDERER_JOBSCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs independent jobs on a fixed set of worker threads, each with its own
+// deque. Submissions are spread over the deques, a worker runs its newest job
+// first and, once its deque is empty, steals the oldest job of another
+// worker, so a mix of long and short jobs keeps every core busy. Unlike
+// ThreadPool the submitting thread does not take part.
+class JobScheduler {
+public:
+    // The index of the worker running the job, in [0, size())
+    using Job = std::function<void(int worker)>;
+
+    explicit JobScheduler(int threads = 0); // 0 means one thread per hardware core
+    // Runs the jobs still queued, then joins the workers
+    ~JobScheduler();
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    [[nodiscard]] int size() const { return static_cast<int>(mThreads.size()); }
+
+    // Thread-safe, a job submitted from a job goes to the deque of its worker
+    void submit(Job job);
+    // Blocks until every job submitted so far has finished
+    void wait();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void workerLoop(int index);
+    // Newest job of the own queue, otherwise the oldest one of another
+    [[nodiscard]] Job take(int index);
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mThreads;
+    unsigned mNextQueue = 0;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mIdle;
+    long mAvailable = 0;   // queued jobs no worker has claimed yet
+    long mUnfinished = 0;  // submitted jobs that have not returned
+    bool mStop = false;
+};
+
+#endif //MYRENDERER_JOBSCHEDULER_H
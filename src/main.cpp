@@ -1,141 +1,40 @@
+#include <algorithm>
 #include <vector>
 #include <limits>
 #include <array>
-
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "batch.h"
+#include "camerapath.h"
+#include "framerenderer.h"
+#include "framesink.h"
 #include "model.h"
 #include "geometry.h"
+#include "profiler.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "tgawriter.h"
 
 static const TGAColor white{ 255, 255, 255, 255 };
 static const TGAColor red{ 255, 0,   0,   255 };
 static const TGAColor green{ 0, 255,   0,   255 };
 static const TGAColor blue{ 0, 0, 255, 255 };
 
-static const auto width = 800;
-static const auto height = 800;
+// Output resolution, --size overrides it
+static auto width = 800;
+static auto height = 800;
 static const auto depth = 255;
 
 static Model* model = nullptr;
-static int* zbuffer = nullptr;
 static const Vec3f eye{ 1, 1, 3 };
-static Vec3f center{ 0, 0, 0 };
+static const Vec3f center{ 0, 0, 0 };
 static const auto lightDir = Vec3f{1, -1, 1}.normalize();
-
-void line(Vec2i p0, Vec2i p1, TGAImage& image, const TGAColor& color) {
-    auto x0 = p0.x;
-    auto x1 = p1.x;
-    auto y0 = p0.y;
-    auto y1 = p1.y;
-
-    auto steep = false;
-    if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
-        std::swap(x0, y0);
-        std::swap(x1, y1);
-        steep = true;
-    }
-
-    if (x0 > x1) {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
-    }
-
-    const auto dx = x1 - x0;
-    const auto dy = y1 - y0;
-    const auto derror2 = std::abs(dy) * 2;
-    auto error2 = 0;
-    auto y = y0;
-
-    for (int x = x0; x < x1; ++x) {
-        if (steep) {
-            image.set(y, x, color);
-        } else {
-            image.set(x, y, color);
-        }
-        error2 += derror2;
-        if (error2 > dx) {
-            y += (y1 > y0 ? 1 : -1);
-            error2 -= dx *2;
-        }
-    }
-}
-
-Vec3f barycentric(const std::array<Vec3f, 3>& pts, Vec3f p) {
-    const auto u = Vec3f{ static_cast<float>(pts[2].x - pts[0].x),
-                          static_cast<float>(pts[1].x - pts[0].x),
-                          static_cast<float>(pts[0].x - p.x) } ^
-                   Vec3f{ static_cast<float>(pts[2].y - pts[0].y),
-                          static_cast<float>(pts[1].y - pts[0].y),
-                          static_cast<float>(pts[0].y - p.y) };
-
-    if (std::abs(u.z) < 1) {
-        return Vec3f{ -1, 1, 1 };
-    }
-    return Vec3f{ 1.f - (u.x + u.y)/u.z, u.x/u.z, u.y/u.z };
-}
-void triangle(std::array<Vec3f, 3>& pts, float *buffer, TGAImage& image, const TGAColor& color) {
-    Vec2f bboxmin{ std::numeric_limits<float>::max(),  std::numeric_limits<float>::max() };
-    Vec2f bboxmax{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
-    Vec2f clamp{ static_cast<float>(image.get_width()-1), static_cast<float>(image.get_height()-1) };
-
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
-            bboxmin[j] = std::max(0.f,      std::min(bboxmin[j], pts[i][j]));
-            bboxmax[j] = std::min(clamp[j], std::max(bboxmax[j], pts[i][j]));
-        }
-    }
-
-    Vec3f p;
-    for (p.x=bboxmin.x; p.x <= bboxmax.x; p.x++) {
-        for (p.y=bboxmin.y; p.y <= bboxmax.y; p.y++) {
-            auto bcScreen  = barycentric(pts, p);
-
-            if (bcScreen.x < 0 || bcScreen.y < 0 || bcScreen.z < 0) continue;
-
-            p.z = 0;
-            for (int i=0; i<3; i++) {
-                p.z += pts[i][2] * bcScreen[i];
-            }
-            const auto idx = static_cast<int>(p.x + p.y * width);
-            if (buffer[idx] < p.z) {
-                buffer[idx] = p.z;
-                image.set(p.x, p.y, color);
-            }
-        }
-    }
-}
-
-void triangleOld(std::array<Vec3i, 3>& v, std::array<float, 3>& ity, TGAImage& image, int *buffer) {
-
-    if (v[0].y == v[1].y && v[0].y == v[2].y) return; // i dont care about degenerate triangles
-
-    if (v[0].y > v[1].y) { std::swap(v[0], v[1]); std::swap(ity[0], ity[1]); }
-    if (v[0].y > v[2].y) { std::swap(v[0], v[2]); std::swap(ity[0], ity[2]); }
-    if (v[1].y > v[2].y) { std::swap(v[1], v[2]); std::swap(ity[1], ity[2]); }
-
-    const auto totalHeight = v[2].y - v[0].y;
-    for (int i=0; i < totalHeight; i++) {
-        const auto secondHalf = i > v[1].y - v[0].y || v[1].y == v[0].y;
-        const auto segmentHeight = secondHalf ? v[2].y - v[1].y : v[1].y - v[0].y;
-        const auto alpha = static_cast<float>(i) / totalHeight;
-        const auto beta  = static_cast<float>(i - (secondHalf ? v[1].y - v[0].y : 0)) / segmentHeight;
-        auto A   =               v[0]  + Vec3f{ v[2] - v[0] } * alpha;
-        auto B   = secondHalf ? v[1] + Vec3f{ v[2] - v[1] } * beta : v[0] + Vec3f{ v[1] - v[0]  } * beta;
-        auto ityA = ity[0] + (ity[2] - ity[0]) * alpha;
-        auto ityB = secondHalf ? ity[1] + (ity[2] - ity[1]) * beta : ity[0] + (ity[1] - ity[0]) * beta;
-        if (A.x > B.x) { std::swap(A, B); std::swap(ityA, ityB); }
-        for (int j = A.x; j <= B.x; j++) {
-            const auto phi = B.x == A.x ? 1. : static_cast<float>(j - A.x)/static_cast<float>(B.x - A.x);
-            const auto   P = Vec3f{ A }  + Vec3f{ B - A } * phi;
-            const auto ityP = ityA + (ityB - ityA) * phi;
-            const auto idx = static_cast<int>(P.x + P.y * width);
-            if (P.x >= width || P.y >= height || P.x < 0 || P.y < 0) continue;
-            if (buffer[idx] < P.z) {
-                buffer[idx] = P.z;
-                image.set(P.x, P.y, TGAColor{255, 255, 255} * ityP);
-            }
-        }
-    }
-}
-
+static const auto SHADOW_MAP_SIZE = 2048;
 
 Vec3i world2screen(const Vec3f& v) {
     return Vec3i{static_cast<int>((v.x + 1.0f) * width/2.0f + 0.5f),
@@ -144,139 +43,327 @@ Vec3i world2screen(const Vec3f& v) {
 }
 
 
-Vec3f mat2vec(Matrix m) {
-    return Vec3f{ m[0][0]/m[3][0], m[1][0]/m[3][0], m[2][0]/m[3][0] };
-}
-
-Matrix vec2mat(const Vec3f& v) {
-    Matrix res{ 4, 1 };
-    res[0][0] = v.x;
-    res[1][0] = v.y;
-    res[2][0] = v.z;
-    res[3][0] = 1.0f;
-    return res;
-}
-
-Matrix viewport(int x, int y, int w, int h) {
-    auto res = Matrix::eye(4);
-    res[0][3] = x + w / 2.f;
-    res[1][3] = y + h / 2.f;
-    res[2][3] = depth / 2.f;
-
-    res[0][0] = w / 2.f;
-    res[1][1] = h / 2.f;
-    res[2][2] = depth / 2.f;
-    return res;
-}
-
-Matrix lookAt(const Vec3f& eye, Vec3f& center, const Vec3f& up) {
-    auto z = (eye - center).normalize();
-    auto x = (up^z).normalize();
-    auto y = (z^x).normalize();
-    auto res = Matrix::eye(4);
-    for (int i = 0; i < 3; ++i) {
-        res[0][i] = x[i];
-        res[1][i] = y[i];
-        res[2][i] = z[i];
-        res[i][3] = -center[i];
-    }
-    return res;
-}
-
-Matrix translation(const Vec3f& v) {
-    auto res = Matrix::eye(4);
+Mat4f translation(const Vec3f& v) {
+    auto res = Mat4f::identity();
     res[0][3] = v.x;
     res[1][3] = v.y;
     res[2][3] = v.z;
     return res;
 }
 
-Matrix zoom(float factor) {
-    auto res = Matrix::eye(4);
+Mat4f zoom(float factor) {
+    auto res = Mat4f::identity();
     res[0][0] = res[1][1] = res[2][2] = factor;
     return res;
 }
 
-Matrix rotX(float angle) {
-    auto res = Matrix::eye(4);
+Mat4f rotX(float angle) {
+    auto res = Mat4f::identity();
     res[1][1] = res[2][2] = cosf(angle);
     res[1][2] = -sinf(angle);
     res[2][1] = sinf(angle);
     return res;
 }
 
-Matrix rotY(float angle) {
-    auto res = Matrix::eye(4);
+Mat4f rotY(float angle) {
+    auto res = Mat4f::identity();
     res[0][0] = res[2][2] = cosf(angle);
     res[0][2] = -sinf(angle);
     res[2][0] = sinf(angle);
     return res;
 }
 
-Matrix rotZ(float angle) {
-    auto res = Matrix::eye(4);
+Mat4f rotZ(float angle) {
+    auto res = Mat4f::identity();
     res[0][0] = res[1][1] = cosf(angle);
     res[0][1] = -sinf(angle);
     res[1][0] = sinf(angle);
     return res;
 }
 
+static void usage(const char *name) {
+    std::cerr << "Usage: " << name << " [-t threads] [--simd level] [--size WxH] [--no-cache] [--visibility|--shader name|--msaa N]\n"
+              << "       " << std::string(std::strlen(name), ' ') << " [--z-prepass] [--shadows [--pcf N]] [--optimal-tga] [-o output] [--format tga|ppm|raw] [--frames N [--keyframes file]]\n"
+              << "       " << std::string(std::strlen(name), ' ') << " [--profile] [--trace file] [model.obj]\n"
+              << "       " << name << " --build-cache model.obj...\n"
+              << "       " << name << " [-t threads] [--model-budget MB] --batch manifest|--listen socket\n"
+              << "  -t, --threads N   rasterizer threads, 0 uses every core (default)\n"
+              << "  --simd LEVEL      scalar, sse2 or avx2, defaults to the best the CPU has\n"
+              << "  --size WxH        output resolution, 800x800 by default\n"
+              << "  --no-cache        neither read nor write the binary mesh cache\n"
+              << "  --visibility      rasterize into a visibility buffer, then shade textured pixels once\n"
+              << "  --shader NAME     draw through the gouraud, textured or phong shader pipeline\n"
+              << "  --msaa N          antialias the forward pass with 4 or 8 coverage and depth samples per pixel\n"
+              << "  --z-prepass       with --shader, lay down depth first, then shade only the nearest fragments\n"
+              << "  --shadows         cast shadows, from a depth map drawn from the light\n"
+              << "  --pcf N           soften them by averaging (2N+1)^2 shadow map texels\n"
+              << "  --optimal-tga     smallest RLE packets that stay within a scanline, as TGA 2.0 asks\n"
+              << "  -o, --output PATH where the frame goes, output.tga by default, - is stdout\n"
+              << "  --format FORMAT   tga, ppm (P6) or raw rgb24, guessed from the output name\n"
+              << "  --frames N        render an animation of N frames, one turn around the model unless\n"
+              << "                    --keyframes names a file of \"eye.xyz center.xyz\" lines to move through;\n"
+              << "                    a TGA output name takes the frame number with a %d, e.g. frame%04d.tga\n"
+              << "  --profile         time the pipeline stages and count triangles, fragments and bytes,\n"
+              << "                    then print a one-line summary\n"
+              << "  --trace FILE      --profile and write the timeline as a Chrome trace, for chrome://tracing\n"
+              << "  --batch FILE      render the jobs of a manifest, - reads stdin, one job per line:\n"
+              << "                    model=M output=O [size=WxH] [eye=x,y,z] [center=x,y,z] [mode=forward|visibility]\n"
+              << "  --listen PATH     take jobs as manifest lines on a Unix socket, each answered by ok or error\n"
+              << "  --model-budget MB memory for models no batch job uses, 1024 by default\n"
+              << "  --build-cache     (re)build the mesh caches of the given models and exit\n";
+}
+
 int main(int argc, char** argv) {
-    if (2==argc) {
-        model = new Model(argv[1]);
-    } else {
-        model = new Model("../resources/african_head.obj");
+    std::vector<const char *> modelFiles;
+    auto threads = 0;
+    auto useCache = true;
+    auto buildCache = false;
+    auto deferred = false;
+    auto useShader = false;
+    auto shader = ShaderKind::Textured;
+    auto samples = 1;
+    auto depthPrepass = false;
+    auto shadows = false;
+    auto pcf = 0;
+    TgaWriteOptions tgaOptions;
+    std::string output{ "output.tga" };
+    std::string format;
+    auto frames = 1;
+    std::string keyframes;
+    std::string batchManifest;
+    std::string batchSocket;
+    auto modelBudget = 1024L;
+    auto profiling = false;
+    std::string traceFile;
+    for (int i = 1; i < argc; ++i) {
+        if ((!std::strcmp(argv[i], "-t") || !std::strcmp(argv[i], "--threads")) && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--simd") && i + 1 < argc) {
+            const std::string level{ argv[++i] };
+            setSimdLevel(level == "avx2" ? SimdLevel::AVX2 : level == "sse2" ? SimdLevel::SSE2 : SimdLevel::Scalar);
+        } else if (!std::strcmp(argv[i], "--size") && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0 || width > 16384 || height > 16384) {
+                std::cerr << "bad size " << argv[i] << ", expected WIDTHxHEIGHT up to 16384x16384\n";
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--no-cache")) {
+            useCache = false;
+        } else if (!std::strcmp(argv[i], "--visibility")) {
+            deferred = true;
+        } else if (!std::strcmp(argv[i], "--shader") && i + 1 < argc) {
+            if (!parseShaderKind(argv[++i], shader)) {
+                usage(argv[0]);
+                return 1;
+            }
+            useShader = true;
+        } else if (!std::strcmp(argv[i], "--msaa") && i + 1 < argc) {
+            samples = std::stoi(argv[++i]);
+            if (!isSampleCount(samples)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--z-prepass")) {
+            depthPrepass = true;
+        } else if (!std::strcmp(argv[i], "--shadows")) {
+            shadows = true;
+        } else if (!std::strcmp(argv[i], "--pcf") && i + 1 < argc) {
+            pcf = std::stoi(argv[++i]);
+            if (pcf < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--optimal-tga")) {
+            tgaOptions.packets = TgaPackets::Optimal;
+        } else if ((!std::strcmp(argv[i], "-o") || !std::strcmp(argv[i], "--output")) && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!std::strcmp(argv[i], "--format") && i + 1 < argc) {
+            format = argv[++i];
+            if (format != "tga" && format != "ppm" && format != "raw") {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = std::stoi(argv[++i]);
+            if (frames <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--keyframes") && i + 1 < argc) {
+            keyframes = argv[++i];
+        } else if (!std::strcmp(argv[i], "--batch") && i + 1 < argc) {
+            batchManifest = argv[++i];
+        } else if (!std::strcmp(argv[i], "--listen") && i + 1 < argc) {
+            batchSocket = argv[++i];
+        } else if (!std::strcmp(argv[i], "--model-budget") && i + 1 < argc) {
+            modelBudget = std::stol(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--profile")) {
+            profiling = true;
+        } else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+            profiling = true;
+            traceFile = argv[++i];
+        } else if (!std::strcmp(argv[i], "--build-cache")) {
+            buildCache = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            modelFiles.push_back(argv[i]);
+        }
+    }
+#ifdef SIGPIPE
+    // A reader of -o - or a --listen client that goes away should fail the write, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    profile::setThreadName("main");
+    profile::setEnabled(profiling);
+    // Summary and trace once every thread is done recording
+    const auto reportProfile = [&] {
+        if (!profiling) return true;
+        std::cerr << profile::summary() << '\n';
+        return traceFile.empty() || profile::writeChromeTrace(traceFile);
+    };
+
+    if (!batchManifest.empty() || !batchSocket.empty()) {
+        BatchOptions options;
+        options.threads = threads;
+        options.modelBudget = static_cast<std::size_t>(std::max(0L, modelBudget)) << 20;
+        options.useMeshCache = useCache;
+        options.tga = tgaOptions;
+        const auto ok = batchSocket.empty() ? runBatch(batchManifest, options, lightDir)
+                                            : serveBatch(batchSocket, options, lightDir);
+        return reportProfile() && ok ? 0 : 1;
+    }
+    if (modelFiles.empty()) {
+        modelFiles.push_back("../resources/african_head.obj");
+    }
+    ThreadPool pool{ threads };
+
+    if (buildCache) {
+        auto ok = true;
+        for (const auto *file: modelFiles) {
+            const auto built = Model::buildCache(file, pool);
+            std::cerr << (built ? "Built mesh cache for " : "Failed to build mesh cache for ") << file << '\n';
+            ok = ok && built;
+        }
+        return ok ? 0 : 1;
+    }
+    // Multisampling is done by the fixed forward pass only, the prepass by the shader pipeline
+    if (modelFiles.size() > 1 || (samples > 1 && (deferred || useShader)) || (depthPrepass && !useShader)) {
+        usage(argv[0]);
+        return 1;
+    }
+    const auto frameFormat = format.empty() ? frameFormatOf(output)
+                           : format == "ppm" ? FrameFormat::Ppm : format == "raw" ? FrameFormat::Raw : FrameFormat::Tga;
+    auto path = CameraPath::orbit(Camera{ eye, center });
+    if (!keyframes.empty() && !CameraPath::loadKeyframes(keyframes, path)) {
+        return 1;
+    }
+    const auto sink = openFrameSink(output, frameFormat, tgaOptions);
+    if (!sink) {
+        return 1;
+    }
+    {
+        PROFILE_SCOPE("load model");
+        model = new Model(modelFiles[0], pool, useCache);
+    }
+    if (model->nfaces() == 0) {
+        std::cerr << "nothing to render in " << modelFiles[0] << "\n";
+        return 1;
     }
 
-    zbuffer = new int[ width * height ];
-    std::fill(zbuffer, zbuffer + width * height, std::numeric_limits<int>::min());
-
-    { // draw the model
-        auto modelView = lookAt(eye, center, Vec3f{0, 1, 0});
-        auto projection = Matrix::eye(4);
-        auto vp = viewport(width/8, height/8, width*3/4, height*3/4);
-        projection[3][2] = -1.f / (eye - center).norm();
-
-        std::cerr << modelView << '\n';
-        std::cerr << projection << '\n';
-        std::cerr << vp << '\n';
-        const auto transform = (vp * projection * modelView);
-        std::cerr << transform << '\n';
-
-        TGAImage image(width, height, TGAImage::RGB);
-        for (int i = 0; i < model->nfaces(); i++) {
-            const auto face = model->getFace(i);
-
-            std::array<Vec3i, 3> screen_coords;
-            std::array<Vec3f, 3> world_coords;
-
-            std::array<float, 3> intensities;
-            for (int j = 0; j < 3; j++) {
-                Vec3f v = model->getVert(face[j]);
-                screen_coords[j] = mat2vec(vp * projection * modelView * vec2mat(v));
-                world_coords[j]  = v;
-                intensities[j] = model->getNorm(i, j) * lightDir;
+    FrameRenderer renderer{ width, height, deferred, pool, samples };
+    renderer.setDepthPrepass(depthPrepass);
+    // Neither the model nor the light move, one map serves every frame
+    std::unique_ptr<ShadowMap> shadowMap;
+    if (shadows) {
+        const auto start = std::chrono::steady_clock::now();
+        shadowMap = std::make_unique<ShadowMap>(SHADOW_MAP_SIZE, pool);
+        shadowMap->render(*model, lightDir);
+        renderer.setShadows(shadowMap.get(), pcf);
+        std::cerr << "Shadow map " << SHADOW_MAP_SIZE << 'x' << SHADOW_MAP_SIZE << " of " << shadowMap->rasterized()
+                  << " triangles in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+    }
+    // Milliseconds summed over all frames
+    FrameRenderer::Times times;
+    auto submitTime = 0.;
+    // Per-frame details only for a single frame
+    const auto verbose = frames == 1;
+    using Clock = std::chrono::steady_clock;
+    const auto since = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+    const auto animationStart = Clock::now();
+
+    for (int f = 0; f < frames; ++f) { // draw the model
+        PROFILE_SCOPE("frame");
+        const auto camera = path.at(f, frames);
+        const auto transform = camera.transform(width, height);
+        if (useShader) {
+            renderer.render(*model, camera, shader, lightDir);
+        } else {
+            renderer.render(*model, transform, lightDir);
+        }
+        const auto& t = renderer.times();
+        times.cull += t.cull;
+        times.geometry += t.geometry;
+        times.raster += t.raster;
+        times.shade += t.shade;
+
+        if (verbose) {
+            const auto& bvhStats = renderer.bvhStats();
+            std::cerr << "BVH visited " << bvhStats.nodes << " nodes, rejected " << bvhStats.outside << " faces outside the frustum and "
+                      << bvhStats.occluded << " occluded of " << model->nfaces() << '\n';
+            const auto& vertices = renderer.vertexStats();
+            std::cerr << "Transformed " << vertices.transformed << " vertices, reused "
+                      << vertices.reused() << " of " << vertices.fetched << " fetches\n";
+            const auto& prims = renderer.primitiveStats();
+            std::cerr << "Culled " << prims.culled() << " of " << prims.triangles << " triangles (" << prims.backFacing
+                      << " back-facing, " << prims.outside << " outside), clipped " << prims.clipped << "\n";
+            std::cerr << "Rasterized " << renderer.rasterized() << " triangles in " << renderer.ntiles()
+                      << " tiles on " << pool.size() << " threads (" << simdName(simdLevel()) << "): " << t.raster << " ms\n";
+            const auto& hiz = renderer.rasterStats();
+            std::cerr << "Depth rejected " << hiz.rejectedTriangles << " of " << hiz.triangles << " binned triangles and "
+                      << hiz.rejectedBlocks << " of " << hiz.blocks << " 8x8 blocks\n";
+            if (deferred && !useShader) {
+                const auto shaded = renderer.shaded();
+                std::cerr << "Shaded " << shaded << " pixels once in " << t.shade << " ms, " << hiz.fragments
+                          << " fragments passed depth (overdraw " << (shaded ? static_cast<double>(hiz.fragments) / shaded : 0.) << ")\n";
+            } else {
+                std::cerr << "Shaded " << (useShader ? renderer.shaded() : hiz.fragments) << " fragments\n";
+            }
+            if (samples > 1) {
+                const auto msaa = renderer.msaaStats();
+                std::cerr << "Resolved " << samples << " samples per pixel in " << t.shade << " ms, " << msaa.expanded << " of "
+                          << msaa.pixels << " pixels expanded, " << msaa.bytes / 1e6 << " MB of sample storage\n";
             }
-            triangleOld(screen_coords, intensities, image, zbuffer);
-
         }
 
-//        image.flip_vertically();
-        image.write_tga_file("output.tga");
+        // Returns once the previous frame is out, this one is encoded while the next renders
+        const auto start = Clock::now();
+        sink->submit(renderer.frame().image());
+        submitTime += since(start);
+        profile::endFrame();
     }
+    const auto written = sink->finish();
+    const auto total = since(animationStart);
+    const auto out = sink->stats();
+    std::cerr << "Rendered " << frames << (frames == 1 ? " frame in " : " frames in ") << total << " ms ("
+              << frames * 1e3 / total << " fps), per frame: cull " << times.cull / frames << ", geometry "
+              << times.geometry / frames << ", raster " << times.raster / frames << ", shade " << times.shade / frames
+              << ", submit " << submitTime / frames << " (stalled " << out.stall / frames << ") ms, encode "
+              << out.encode / frames << ", write " << out.write / frames << " ms on the writer thread\n";
 
     { // dump z-buffer
         TGAImage zbimage(width, height, TGAImage::GRAYSCALE);
-        for (int i = 0; i < width; i++) {
-            for (int j = 0; j < height; j++) {
-                zbimage.set(i, j, TGAColor{ static_cast<uint8_t>(zbuffer[i+j*width]) });
-            }
+        auto *gray = zbimage.buffer();
+        const auto *zbuffer = renderer.depth().data();
+        for (int i = 0; i < width * height; i++) {
+            gray[i] = static_cast<uint8_t>(std::max(0.f, std::min(255.f, zbuffer[i])));
         }
 //        zbimage.flip_vertically();
-        zbimage.write_tga_file("zbuffer.tga");
+        writeTga("zbuffer.tga", zbimage, tgaOptions, pool);
     }
     delete model;
-    delete[] zbuffer;
-    return 0;
+    return reportProfile() && written ? 0 : 1;
 }
 
@@ -0,0 +1,96 @@
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename) {
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return;
+    }
+    mFile = file;
+    mSize = static_cast<std::size_t>(size.QuadPart);
+    mOpen = true;
+    if (!mSize) return;
+    mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping) {
+        mData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!mData) close();
+}
+
+void MappedFile::close() {
+    if (mData) UnmapViewOfFile(mData);
+    if (mMapping) CloseHandle(mMapping);
+    if (mFile) CloseHandle(mFile);
+    mData = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+#else
+MappedFile::MappedFile(const std::string& filename) {
+    const auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st{};
+    if (fstat(fd, &st) == 0) {
+        mSize = static_cast<std::size_t>(st.st_size);
+        mOpen = true;
+        if (mSize) {
+            auto *ptr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                madvise(ptr, mSize, MADV_SEQUENTIAL);
+                mData = static_cast<const char *>(ptr);
+            } else {
+                mSize = 0;
+                mOpen = false;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+void MappedFile::close() {
+    if (mData) munmap(const_cast<char *>(mData), mSize);
+    mData = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(mData, other.mData);
+        std::swap(mSize, other.mSize);
+        std::swap(mOpen, other.mOpen);
+#ifdef _WIN32
+        std::swap(mFile, other.mFile);
+        std::swap(mMapping, other.mMapping);
+#endif
+    }
+    return *this;
+}
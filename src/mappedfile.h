@@ -0,0 +1,34 @@
+#ifndef MYRENDERER_MAPPEDFILE_H
+#define MYRENDERER_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] bool isOpen() const { return mOpen; }
+    [[nodiscard]] const char* data() const { return mData; }
+    [[nodiscard]] std::size_t size() const { return mSize; }
+
+private:
+    void close();
+
+    const char *mData = nullptr;
+    std::size_t mSize = 0;
+    bool mOpen = false;
+#ifdef _WIN32
+    void *mFile = nullptr;
+    void *mMapping = nullptr;
+#endif
+};
+
+#endif //MYRENDERER_MAPPEDFILE_H
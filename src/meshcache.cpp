@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "meshcache.h"
+
+namespace {
+
+const char MAGIC[8] = { 'M', 'R', 'M', 'E', 'S', 'H', '\0', '\0' };
+const std::uint32_t VERSION = 5;
+// Every array starts at a multiple of this, so mapped data can be used in place
+const std::uint64_t ALIGNMENT = 64;
+
+enum Section { VERTS, UV, NORMS, VERT_IDX, UV_IDX, NORM_IDX, BVH, TEXTURE, NSECTIONS };
+
+#pragma pack(push,1)
+struct CacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t headerSize;
+    std::int64_t objSize;
+    std::int64_t objMtime;
+    std::int64_t texSize;
+    std::int64_t texMtime;
+    std::int32_t texWidth;
+    std::int32_t texHeight;
+    std::int64_t reserved;
+    std::uint64_t offset[NSECTIONS];
+    std::uint64_t count[NSECTIONS];
+};
+#pragma pack(pop)
+
+const std::uint64_t ELEMENT_SIZE[NSECTIONS] = { sizeof(Vec3f), sizeof(Vec2f), sizeof(Vec3f), sizeof(int), sizeof(int), sizeof(int), sizeof(BvhNode), sizeof(std::uint32_t) };
+
+std::uint64_t alignUp(std::uint64_t v) {
+    return (v + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+template <class T>
+ArrayView<T> section(const MappedFile& file, const CacheHeader& h, Section s) {
+    return ArrayView<T>{ reinterpret_cast<const T *>(file.data() + h.offset[s]), h.count[s] };
+}
+
+}
+
+FileStamp FileStamp::of(const std::string& filename) {
+    std::error_code ec;
+    FileStamp stamp;
+    const auto size = std::filesystem::file_size(filename, ec);
+    if (ec) return stamp;
+    const auto mtime = std::filesystem::last_write_time(filename, ec);
+    if (ec) return stamp;
+    stamp.size = static_cast<std::int64_t>(size);
+    stamp.mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+    return stamp;
+}
+
+std::string meshCachePath(const std::string& objFile) {
+    const auto dot = objFile.find_last_of('.');
+    const auto slash = objFile.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return objFile + ".mrmesh";
+    return objFile.substr(0, dot) + ".mrmesh";
+}
+
+bool writeMeshCache(const std::string& path, const FileStamp& obj, const FileStamp& tex, const MeshData& data) {
+    CacheHeader h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.headerSize = sizeof(CacheHeader);
+    h.objSize = obj.size;
+    h.objMtime = obj.mtime;
+    h.texSize = tex.size;
+    h.texMtime = tex.mtime;
+    h.texWidth = data.texWidth;
+    h.texHeight = data.texHeight;
+
+    const void *ptr[NSECTIONS] = { data.verts.data(), data.uv.data(), data.norms.data(),
+                                   data.vertIdx.data(), data.uvIdx.data(), data.normIdx.data(), data.bvh.data(), data.texels.data() };
+    h.count[VERTS] = data.verts.size();
+    h.count[UV] = data.uv.size();
+    h.count[NORMS] = data.norms.size();
+    h.count[VERT_IDX] = data.vertIdx.size();
+    h.count[UV_IDX] = data.uvIdx.size();
+    h.count[NORM_IDX] = data.normIdx.size();
+    h.count[BVH] = data.bvh.size();
+    h.count[TEXTURE] = data.texels.size();
+    auto offset = alignUp(sizeof(CacheHeader));
+    for (int s = 0; s < NSECTIONS; ++s) {
+        h.offset[s] = offset;
+        offset = alignUp(offset + h.count[s] * ELEMENT_SIZE[s]);
+    }
+
+    // Written under a temporary name and renamed, a reader never maps half a file
+    const auto tmp = path + ".tmp";
+    std::ofstream out{ tmp, std::ios::binary };
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << tmp << "\n";
+        return false;
+    }
+    const char zeros[ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    auto pos = static_cast<std::uint64_t>(sizeof(h));
+    for (int s = 0; s < NSECTIONS; ++s) {
+        out.write(zeros, h.offset[s] - pos);
+        out.write(static_cast<const char *>(ptr[s]), h.count[s] * ELEMENT_SIZE[s]);
+        pos = h.offset[s] + h.count[s] * ELEMENT_SIZE[s];
+    }
+    out.close();
+    if (!out.good()) {
+        std::cerr << "can't write the mesh cache " << tmp << "\n";
+        std::filesystem::remove(tmp);
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "can't write the mesh cache " << path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool openMeshCache(const std::string& path, const FileStamp& obj, const FileStamp& tex, MappedFile& file, MeshData& data) {
+    // Without the OBJ there is nothing the cache could be up to date with
+    if (obj.size < 0) return false;
+    MappedFile mapped{ path };
+    if (!mapped.isOpen() || mapped.size() < sizeof(CacheHeader)) return false;
+
+    CacheHeader h;
+    std::memcpy(&h, mapped.data(), sizeof(h));
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION || h.headerSize != sizeof(CacheHeader)) {
+        std::cerr << "Mesh cache " << path << " has an unknown format, ignoring it\n";
+        return false;
+    }
+    if (!(FileStamp{ h.objSize, h.objMtime } == obj) || !(FileStamp{ h.texSize, h.texMtime } == tex)) {
+        std::cerr << "Mesh cache " << path << " is out of date\n";
+        return false;
+    }
+    for (int s = 0; s < NSECTIONS; ++s) {
+        if (h.offset[s] % ALIGNMENT || h.offset[s] > mapped.size() ||
+            h.count[s] > (mapped.size() - h.offset[s]) / ELEMENT_SIZE[s]) {
+            std::cerr << "Mesh cache " << path << " is truncated, ignoring it\n";
+            return false;
+        }
+    }
+    if (h.count[VERT_IDX] % 3 || h.count[UV_IDX] != h.count[VERT_IDX] || h.count[NORM_IDX] != h.count[VERT_IDX]) {
+        std::cerr << "Mesh cache " << path << " has bad index streams, ignoring it\n";
+        return false;
+    }
+    if (h.texWidth < 0 || h.texHeight < 0 || h.count[TEXTURE] != Texture::storageSize(h.texWidth, h.texHeight)) {
+        std::cerr << "Mesh cache " << path << " has a bad texture, ignoring it\n";
+        return false;
+    }
+
+    // Faces index the attribute arrays directly, prepared models have no -1 left
+    const Section streams[3][2] = { { VERT_IDX, VERTS }, { UV_IDX, UV }, { NORM_IDX, NORMS } };
+    for (const auto& stream: streams) {
+        const auto indices = section<int>(mapped, h, stream[0]);
+        const auto count = h.count[stream[1]];
+        if (!std::all_of(indices.begin(), indices.end(), [&](int i) { return i >= 0 && static_cast<std::uint64_t>(i) < count; })) {
+            std::cerr << "Mesh cache " << path << " has bad indices, ignoring it\n";
+            return false;
+        }
+    }
+
+    const auto bvh = section<BvhNode>(mapped, h, BVH);
+    const auto nfaces = static_cast<std::int64_t>(h.count[VERT_IDX] / 3);
+    for (std::size_t i = 0; i < bvh.size(); ++i) {
+        const auto& n = bvh[i];
+        const auto ok = n.leaf() ? n.first >= 0 && std::int64_t{ n.first } + n.count <= nfaces
+                                 : n.count == 0 && n.first > static_cast<std::int64_t>(i) && n.first + std::size_t{ 1 } < bvh.size();
+        if (!ok) {
+            std::cerr << "Mesh cache " << path << " has a bad BVH, ignoring it\n";
+            return false;
+        }
+    }
+
+    data.verts     = section<Vec3f>(mapped, h, VERTS);
+    data.uv        = section<Vec2f>(mapped, h, UV);
+    data.norms     = section<Vec3f>(mapped, h, NORMS);
+    data.vertIdx   = section<int>(mapped, h, VERT_IDX);
+    data.uvIdx     = section<int>(mapped, h, UV_IDX);
+    data.normIdx   = section<int>(mapped, h, NORM_IDX);
+    data.bvh       = section<BvhNode>(mapped, h, BVH);
+    data.texels    = section<std::uint32_t>(mapped, h, TEXTURE);
+    data.texWidth  = h.texWidth;
+    data.texHeight = h.texHeight;
+    // The views point into the mapping, moving it keeps the addresses
+    file = std::move(mapped);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef MYRENDERER_MESHCACHE_H
+#define MYRENDERER_MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "arrayview.h"
+#include "bvh.h"
+#include "geometry.h"
+#include "mappedfile.h"
+#include "texture.h"
+
+// Identifies the version of a source file a cache was built from
+struct FileStamp {
+    std::int64_t size = -1; // -1 when the file does not exist
+    std::int64_t mtime = 0;
+
+    static FileStamp of(const std::string& filename);
+    bool operator==(const FileStamp& o) const { return size == o.size && mtime == o.mtime; }
+};
+
+// Flat mesh arrays, face hierarchy and the decoded diffuse texture of a model
+struct MeshData {
+    ArrayView<Vec3f> verts;
+    ArrayView<Vec2f> uv;        // in texel units
+    ArrayView<Vec3f> norms;     // unit length
+    ArrayView<int> vertIdx;     // three per triangle
+    ArrayView<int> uvIdx;
+    ArrayView<int> normIdx;
+    ArrayView<BvhNode> bvh;     // over the faces, which are stored in leaf order
+    ArrayView<std::uint32_t> texels; // Texture storage, blocked and with mips
+    int texWidth = 0;
+    int texHeight = 0;
+};
+
+// Cache files live next to the OBJ, african_head.obj -> african_head.mrmesh
+std::string meshCachePath(const std::string& objFile);
+
+bool writeMeshCache(const std::string& path, const FileStamp& obj, const FileStamp& tex, const MeshData& data);
+
+// Maps path into file and points data into the mapping, without copying.
+// Fails when the cache is missing, damaged or was built from other sources,
+// and when the OBJ itself is missing.
+bool openMeshCache(const std::string& path, const FileStamp& obj, const FileStamp& tex, MappedFile& file, MeshData& data);
+
+#endif //MYRENDERER_MESHCACHE_H
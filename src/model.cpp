@@ -1,92 +1,176 @@
-
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <cstring>
-#include <fstream>
-#include <sstream>
 #include <vector>
 
 #include "model.h"
+#include "profiler.h"
+#include "tgareader.h"
 
-Model::Model(const char *filename) : mVerts(), mFaces(), mNorms(), mUv() {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) {
-        std::cerr << "Error loading model from " << filename << ": " << std::strerror(errno) << '\n';
-    }
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss{ line };
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i = 0; i < 3; i++) {
-                iss >> v[i];
-            }
-            mVerts.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            Vec3f n;
-            for (int i = 0; i < 3; ++i) {
-                iss >> n[i];
-            }
-            mNorms.push_back(n);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            Vec2f uv;
-            for (int i = 0; i < 2; ++i) {
-                iss >> uv[i];
-            }
-            mUv.push_back(uv);
-        } else if (!line.compare(0, 2, "f ")) {
-            std::vector<Vec3i> f;
-            Vec3i tmp;
-            iss >> trash;
-            while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
-                // Indicies start at 1
-                for (int i = 0; i < 3; ++i) {
-                    tmp[i]--;
-                }
-                f.push_back(tmp);
-            }
-            mFaces.push_back(f);
+Model::Model(const char *filename, ThreadPool& pool, bool useCache) {
+    const auto cacheFile = meshCachePath(filename);
+    const auto texfile = texturePath(filename, "_diffuse.tga");
+    if (useCache) {
+        PROFILE_SCOPE("map mesh cache");
+        const auto start = std::chrono::steady_clock::now();
+        if (openMeshCache(cacheFile, FileStamp::of(filename), FileStamp::of(texfile), mCache, mData)) {
+            const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            std::cerr << "# v# " << nverts() << " f# " << nfaces() << " vt# "
+                      << mData.uv.size() << " vn# " << mData.norms.size() << '\n';
+            std::cerr << "Mapped mesh cache " << cacheFile << " in " << elapsed.count() << " ms\n";
+            mDiffuse = Texture{ mData.texels, mData.texWidth, mData.texHeight };
+            return;
         }
     }
-    std::cerr << "# v# " << mVerts.size()
-              << " f# "  << mFaces.size() << " vt# "
-              << mUv.size() << " vn# " << mNorms.size() << '\n';
 
-    loadTexture(filename, "_diffuse.tga", mDiffuseMap);
+    if (!load(filename, pool)) return;
+    if (useCache && writeCache(filename)) {
+        std::cerr << "Wrote mesh cache " << cacheFile << '\n';
+    }
+}
+
+bool Model::buildCache(const char *filename, ThreadPool& pool) {
+    const Model model{ filename, pool, false };
+    return model.writeCache(filename);
 }
 
-// Returns vertices of a face
-std::vector<int> Model::getFace(int idx) {
-    std::vector<int> face;
-    for (auto& vec: mFaces[idx]) {
-        face.push_back(vec[0]);
+bool Model::load(const char *filename, ThreadPool& pool) {
+    const auto start = std::chrono::steady_clock::now();
+    {
+        PROFILE_SCOPE("parse obj");
+        errno = 0;
+        if (!loadObj(filename, pool, mMesh)) {
+            std::cerr << "Error loading model from " << filename;
+            if (errno) std::cerr << ": " << std::strerror(errno);
+            std::cerr << '\n';
+            return false;
+        }
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "# v# " << mMesh.verts.size()
+              << " f# "  << mMesh.nfaces() << " vt# "
+              << mMesh.uv.size() << " vn# " << mMesh.norms.size() << '\n';
+    std::cerr << "Parsed " << mMesh.bytes / 1e6 << " MB in " << elapsed * 1e3 << " ms ("
+              << mMesh.bytes / 1e6 / elapsed << " MB/s)\n";
+
+    TGAImage image;
+    loadTexture(texturePath(filename, "_diffuse.tga"), image);
+    const auto texStart = std::chrono::steady_clock::now();
+    {
+        PROFILE_SCOPE("build texture");
+        mDiffuse = Texture{ image.buffer(), image.get_width(), image.get_height(), image.get_bytespp(), pool };
     }
-    return face;
+    if (!mDiffuse.empty()) {
+        const auto texElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - texStart);
+        std::cerr << "Built " << mDiffuse.levels() << " texture levels in " << texElapsed.count() << " ms\n";
+    }
+    mData.texWidth = mDiffuse.width();
+    mData.texHeight = mDiffuse.height();
+    mData.texels = mDiffuse.texels();
+
+    prepareAttributes(pool);
+    const auto bvhStart = std::chrono::steady_clock::now();
+    {
+        PROFILE_SCOPE("build bvh");
+        mBvh = buildBvh(mMesh, pool);
+    }
+    const auto bvhElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bvhStart);
+    std::cerr << "Built BVH with " << mBvh.size() << " nodes in " << bvhElapsed.count() << " ms\n";
+
+    mData.bvh = mBvh;
+    mData.verts = mMesh.verts;
+    mData.uv = mMesh.uv;
+    mData.norms = mMesh.norms;
+    mData.vertIdx = mMesh.vertIdx;
+    mData.uvIdx = mMesh.uvIdx;
+    mData.normIdx = mMesh.normIdx;
+    return true;
 }
 
-void Model::loadTexture(const std::string& filename, const char *suffix, TGAImage& image) {
-    std::string texfile{ filename };
-    const auto dot = texfile.find_last_of('.');
-    if (dot != std::string::npos) {
-        texfile = texfile.substr(0, dot) + std::string{ suffix };
-        std::cerr << "Texture file " << texfile << " loading " << (image.read_tga_file(texfile.c_str()) ? "ok" : "failed") << '\n';
-        image.flip_vertically();
+void Model::prepareAttributes(ThreadPool& pool) {
+    const auto nidx = static_cast<int>(mMesh.vertIdx.size());
+
+    // Corners without a normal get the area-weighted average of the faces around their vertex
+    if (std::find(mMesh.normIdx.begin(), mMesh.normIdx.end(), -1) != mMesh.normIdx.end()) {
+        const auto base = static_cast<int>(mMesh.norms.size());
+        mMesh.norms.resize(base + mMesh.verts.size(), Vec3f{ 0, 0, 0 });
+        for (int t = 0; t < nidx; t += 3) {
+            const auto *v = &mMesh.vertIdx[t];
+            const auto n = (mMesh.verts[v[1]] - mMesh.verts[v[0]]) ^ (mMesh.verts[v[2]] - mMesh.verts[v[0]]);
+            for (int j = 0; j < 3; ++j) {
+                mMesh.norms[base + v[j]] = mMesh.norms[base + v[j]] + n;
+            }
+        }
+        for (int i = 0; i < nidx; ++i) {
+            if (mMesh.normIdx[i] < 0) mMesh.normIdx[i] = base + mMesh.vertIdx[i];
+        }
     }
+    // Corners without a uv share one at the texture origin
+    if (std::find(mMesh.uvIdx.begin(), mMesh.uvIdx.end(), -1) != mMesh.uvIdx.end()) {
+        const auto origin = static_cast<int>(mMesh.uv.size());
+        mMesh.uv.emplace_back(0.f, 0.f);
+        std::replace(mMesh.uvIdx.begin(), mMesh.uvIdx.end(), -1, origin);
+    }
+
+    // Normalize once with a real sqrt and move uvs to texel space, the getters
+    // are then plain loads
+    const auto texWidth = static_cast<float>(mData.texWidth);
+    const auto texHeight = static_cast<float>(mData.texHeight);
+    const auto batch = 1 << 14;
+    const auto nnorms = static_cast<int>(mMesh.norms.size());
+    const auto nuv = static_cast<int>(mMesh.uv.size());
+    pool.parallelFor((std::max(nnorms, nuv) + batch - 1) / batch, [&](int b) {
+        for (int i = b * batch; i < std::min(nnorms, (b + 1) * batch); ++i) {
+            auto& n = mMesh.norms[i];
+            const auto len = n.norm();
+            n = len > 0 ? n * (1.f / len) : Vec3f{ 0, 0, 0 };
+        }
+        for (int i = b * batch; i < std::min(nuv, (b + 1) * batch); ++i) {
+            mMesh.uv[i] = Vec2f{ mMesh.uv[i].x * texWidth, mMesh.uv[i].y * texHeight };
+        }
+    });
 }
 
-Vec2i Model::getUv(int faceIdx, int nvert) {
-    const auto idx = mFaces[faceIdx][nvert][1];
-    return Vec2i{ static_cast<int>(mUv[idx].x * mDiffuseMap.get_width()),
-                  static_cast<int>(mUv[idx].y * mDiffuseMap.get_height()) };
+bool Model::writeCache(const std::string& filename) const {
+    // A cache of nothing would pass for the model on every later run
+    if (nfaces() == 0) return false;
+    return writeMeshCache(meshCachePath(filename), FileStamp::of(filename),
+                          FileStamp::of(texturePath(filename, "_diffuse.tga")), mData);
+}
+
+std::size_t Model::bytes() const {
+    const auto size = [](const auto& view) { return view.size() * sizeof(*view.data()); };
+    return size(mData.verts) + size(mData.uv) + size(mData.norms) + size(mData.vertIdx) + size(mData.uvIdx) +
+           size(mData.normIdx) + size(mData.bvh) + size(mData.texels);
+}
+
+std::string Model::texturePath(const std::string& filename, const char *suffix) {
+    const auto dot = filename.find_last_of('.');
+    if (dot == std::string::npos) return {};
+    return filename.substr(0, dot) + std::string{ suffix };
+}
+
+void Model::loadTexture(const std::string& texfile, TGAImage& image) {
+    if (!texfile.empty()) {
+        PROFILE_SCOPE("read texture");
+        // Textures are addressed with v going up, the decoder puts the bottom row first
+        const auto start = std::chrono::steady_clock::now();
+        const auto ok = readTga(texfile, image, RowOrder::BottomUp);
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        std::cerr << "Texture file " << texfile << " loading " << (ok ? "ok" : "failed");
+        if (ok) {
+            std::cerr << ", " << image.get_width() << "x" << image.get_height() << "/" << image.get_bytespp() * 8
+                      << " in " << elapsed.count() << " ms";
+        }
+        std::cerr << '\n';
+    }
 }
 
-Vec3f Model::getNorm(int faceIdx, int nvert) {
-    const auto idx = mFaces[faceIdx][nvert][2];
-    return mNorms[idx].normalize();
+TGAColor Model::getDiffuseColor(const Vec2i& uv) const {
+    if (mDiffuse.empty() || uv.x < 0 || uv.y < 0 || uv.x >= mData.texWidth || uv.y >= mData.texHeight) return {};
+    return Texture::toColor(mDiffuse.sampleNearest(static_cast<float>(uv.x), static_cast<float>(uv.y)));
 }
@@ -1,30 +1,66 @@
 #ifndef __MODEL_H__
 #define __MODEL_H__
 
+#include <cstddef>
+#include <string>
 #include <vector>
 
+#include "bvh.h"
 #include "geometry.h"
+#include "mappedfile.h"
+#include "meshcache.h"
+#include "objparser.h"
+#include "texture.h"
+#include "threadpool.h"
 #include "../dependencies/tgaimage.h"
 
 class Model {
 public:
-    explicit Model(const char *filename);
+    // Uses the binary cache next to filename when it is up to date, otherwise
+    // parses the OBJ and texture and (re)writes the cache if useCache is set
+    Model(const char *filename, ThreadPool& pool, bool useCache = true);
     ~Model() = default;
-    [[nodiscard]] int nverts() const { return mVerts.size(); }
-    [[nodiscard]] int nfaces() const { return mFaces.size(); }
-    [[nodiscard]] Vec3f getVert(int i) const { return mVerts[i]; }
-    [[nodiscard]] TGAColor getDiffuseColor(const Vec2i& uv) { return mDiffuseMap.get(uv.x, uv.y); }
-    [[nodiscard]] std::vector<int> getFace(int idx);
-    [[nodiscard]] Vec2i getUv(int faceIdx, int nvert);
-    [[nodiscard]] Vec3f getNorm(int faceIdx, int nvert);
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // Parses filename and its texture and writes a fresh cache for them
+    static bool buildCache(const char *filename, ThreadPool& pool);
+
+    // Memory the mesh, BVH and texture take, mapped or owned
+    [[nodiscard]] std::size_t bytes() const;
+    [[nodiscard]] int nverts() const { return mData.verts.size(); }
+    [[nodiscard]] int nfaces() const { return static_cast<int>(mData.vertIdx.size() / 3); }
+    [[nodiscard]] Vec3f getVert(int i) const { return mData.verts[i]; }
+    [[nodiscard]] const Vec3f* verts() const { return mData.verts.data(); }
+    [[nodiscard]] TGAColor getDiffuseColor(const Vec2i& uv) const;
+    [[nodiscard]] const Texture& diffuse() const { return mDiffuse; }
+    // Vertex indices of a triangle, a view into the index stream
+    [[nodiscard]] ArrayView<int> getFace(int idx) const { return ArrayView<int>{ mData.vertIdx.data() + idx * 3, 3 }; }
+    // Whole index streams, three entries per triangle
+    [[nodiscard]] ArrayView<int> vertIndices() const { return mData.vertIdx; }
+    [[nodiscard]] ArrayView<int> uvIndices() const { return mData.uvIdx; }
+    [[nodiscard]] ArrayView<int> normIndices() const { return mData.normIdx; }
+    // Bounding volume hierarchy over the faces, root first
+    [[nodiscard]] ArrayView<BvhNode> bvh() const { return mData.bvh; }
+    // Texel-space uv and unit normal of a triangle corner, both prepared at load
+    [[nodiscard]] Vec2f getUvf(int faceIdx, int nvert) const { return mData.uv[mData.uvIdx[faceIdx * 3 + nvert]]; }
+    [[nodiscard]] Vec2i getUv(int faceIdx, int nvert) const { const auto uv = getUvf(faceIdx, nvert); return Vec2i{ static_cast<int>(uv.x), static_cast<int>(uv.y) }; }
+    [[nodiscard]] Vec3f getNorm(int faceIdx, int nvert) const { return mData.norms[mData.normIdx[faceIdx * 3 + nvert]]; }
 private:
-    void loadTexture(const std::string& filename, const char *suffix, TGAImage& img);
+    // False, with nothing loaded, when the OBJ can't be read or is broken
+    bool load(const char *filename, ThreadPool& pool);
+    // Fills in missing normals and uvs, normalizes normals and scales uvs to texels
+    void prepareAttributes(ThreadPool& pool);
+    bool writeCache(const std::string& filename) const;
+    static std::string texturePath(const std::string& filename, const char *suffix);
+    static void loadTexture(const std::string& texfile, TGAImage& img);
 
-    std::vector<Vec3f> mVerts;
-    std::vector<std::vector<Vec3i>> mFaces; // attention, this Vec3i means vertex/uv/normal
-    std::vector<Vec3f> mNorms;
-    std::vector<Vec2f> mUv;
-    TGAImage mDiffuseMap;
+    // Either the cache mapping or mMesh, mBvh and mDiffuse own what mData points to
+    MappedFile mCache;
+    ObjMesh mMesh;
+    std::vector<BvhNode> mBvh;
+    Texture mDiffuse;
+    MeshData mData;
 };
 
 #endif //__MODEL_H__
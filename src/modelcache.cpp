@@ -0,0 +1,79 @@
+#include <exception>
+#include <iostream>
+
+#include "modelcache.h"
+
+std::shared_ptr<const Model> ModelCache::acquire(const std::string& filename, ThreadPool& pool) {
+    std::promise<Handle> loaded;
+    std::shared_future<Handle> model;
+    auto load = false;
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        const auto it = mEntries.find(filename);
+        if (it != mEntries.end()) {
+            ++mStats.hits;
+            mLru.splice(mLru.begin(), mLru, it->second.lru);
+            model = it->second.model;
+        } else {
+            ++mStats.loads;
+            load = true;
+            mLru.push_front(filename);
+            model = loaded.get_future().share();
+            mEntries.emplace(filename, Entry{ model, 0, mLru.begin() });
+        }
+    }
+    if (!load) {
+        return model.get();
+    }
+
+    // Outside the lock, other models can be looked up and loaded meanwhile.
+    // Jobs waiting for the load must get an answer even when it throws.
+    Handle handle;
+    try {
+        handle = std::make_shared<const Model>(filename.c_str(), pool, mUseMeshCache);
+    } catch (const std::exception& e) {
+        std::cerr << "can't load " << filename << ": " << e.what() << "\n";
+    }
+    if (handle && handle->nfaces() == 0) {
+        handle = nullptr;
+    }
+    loaded.set_value(handle);
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    const auto it = mEntries.find(filename);
+    if (!handle) {
+        // Not cached, a later job may find the file fixed
+        mLru.erase(it->second.lru);
+        mEntries.erase(it);
+        return nullptr;
+    }
+    it->second.bytes = handle->bytes();
+    mStats.bytes += it->second.bytes;
+    trim();
+    return handle;
+}
+
+void ModelCache::release(std::shared_ptr<const Model>& model) {
+    model.reset();
+    std::lock_guard<std::mutex> lock{ mMutex };
+    trim();
+}
+
+void ModelCache::trim() {
+    for (auto name = mLru.end(); mStats.bytes > mBudget && name != mLru.begin(); ) {
+        --name;
+        const auto it = mEntries.find(*name);
+        auto& entry = it->second;
+        // Entries still loading have no size yet, a use count above one means a job holds the model
+        if (entry.bytes == 0 || entry.model.get().use_count() > 1) continue;
+        mStats.bytes -= entry.bytes;
+        ++mStats.evictions;
+        mEntries.erase(it);
+        name = mLru.erase(name);
+    }
+}
+
+ModelCache::Stats ModelCache::stats() {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mStats;
+}
@@ -0,0 +1,58 @@
+#ifndef MYRENDERER_MODELCACHE_H
+#define MYRENDERER_MODELCACHE_H
+
+#include <cstddef>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "model.h"
+#include "threadpool.h"
+
+// Models shared read-only between render jobs. A model is loaded once, by the
+// first job asking for it, while other jobs asking at the same time wait for
+// that load. Models no job holds any more stay cached until the cached total
+// goes over the budget, then the least recently used of them are dropped.
+// Models in use are never dropped, so the budget can be exceeded by them.
+class ModelCache {
+public:
+    struct Stats {
+        long hits = 0;
+        long loads = 0;
+        long evictions = 0;
+        std::size_t bytes = 0;  // held by cached models
+    };
+
+    explicit ModelCache(std::size_t budget, bool useMeshCache = true)
+        : mBudget(budget), mUseMeshCache(useMeshCache) {}
+
+    // nullptr when filename does not load, pool is used for the loading
+    std::shared_ptr<const Model> acquire(const std::string& filename, ThreadPool& pool);
+    // Drops the reference of a job, which may bring the model up for eviction
+    void release(std::shared_ptr<const Model>& model);
+
+    [[nodiscard]] Stats stats();
+
+private:
+    using Handle = std::shared_ptr<const Model>;
+    struct Entry {
+        std::shared_future<Handle> model;
+        std::size_t bytes = 0;
+        std::list<std::string>::iterator lru;
+    };
+
+    // Drops unused models, least recently used first, until the budget fits
+    void trim();
+
+    const std::size_t mBudget;
+    const bool mUseMeshCache;
+    std::mutex mMutex;
+    std::unordered_map<std::string, Entry> mEntries;
+    std::list<std::string> mLru;  // most recently used first
+    Stats mStats;
+};
+
+#endif //MYRENDERER_MODELCACHE_H
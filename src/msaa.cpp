@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "depthbuffer.h"
+#include "msaa.h"
+#include "profiler.h"
+#include "simd.h"
+
+namespace {
+
+const SamplePattern PATTERN4{ 4, 6, {{ { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } }} };
+const SamplePattern PATTERN8{ 8, 7, {{ { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } }} };
+
+}
+
+bool isSampleCount(int samples) {
+    return samples == 4 || samples == 8;
+}
+
+const SamplePattern& samplePattern(int samples) {
+    assert(isSampleCount(samples));
+    return samples == 8 ? PATTERN8 : PATTERN4;
+}
+
+MsaaBuffer::MsaaBuffer(int width, int height, int samples, int tileSize)
+    : mWidth(width), mHeight(height), mPattern(samplePattern(samples)), mTileSize(tileSize),
+      mTilesX((width + tileSize - 1) / tileSize),
+      mDepth(static_cast<std::size_t>(width) * height * mPattern.count),
+      mColor(static_cast<std::size_t>(width) * height),
+      mSlot(static_cast<std::size_t>(width) * height),
+      mPools(static_cast<std::size_t>(mTilesX) * ((height + tileSize - 1) / tileSize)),
+      mFullMask((1u << mPattern.count) - 1) {
+    clear();
+}
+
+void MsaaBuffer::clear(std::uint32_t bgra) {
+    const auto far = DepthBuffer::FAR;
+    std::uint32_t farBits;
+    std::memcpy(&farBits, &far, sizeof(farBits));
+    fill32(mDepth.data(), mDepth.size(), farBits);
+    fill32(mColor.data(), mColor.size(), bgra);
+    fill32(mSlot.data(), mSlot.size(), COMPRESSED);
+    // Pools keep their capacity, edges are in about the same places next frame
+    for (auto& pool: mPools) {
+        pool.clear();
+    }
+}
+
+void MsaaBuffer::write(int x, int y, unsigned mask, std::uint32_t bgra) {
+    const auto p = static_cast<std::size_t>(y) * mWidth + x;
+    if (mask == mFullMask) {
+        // The samples of a slot given up here stay unused until clear()
+        mColor[p] = bgra;
+        mSlot[p] = COMPRESSED;
+        return;
+    }
+    auto& pool = mPools[tileOf(x, y)];
+    auto slot = mSlot[p];
+    if (slot == COMPRESSED) {
+        if (mColor[p] == bgra) return;
+        slot = static_cast<std::uint32_t>(pool.size());
+        pool.resize(pool.size() + mPattern.count, mColor[p]);
+        mSlot[p] = slot;
+    }
+    auto *samples = pool.data() + slot;
+    for (; mask; mask &= mask - 1) {
+        samples[lowestBit(mask)] = bgra;
+    }
+}
+
+void MsaaBuffer::resolve(Framebuffer& frame, ThreadPool& pool) const {
+    assert(frame.width() == mWidth && frame.height() == mHeight);
+    PROFILE_SCOPE("resolve");
+    const auto n = static_cast<std::uint32_t>(mPattern.count);
+    pool.parallelFor(mHeight, [&](int y) {
+        auto *out = frame.row(y);
+        for (int x = 0; x < mWidth; ++x) {
+            const auto p = static_cast<std::size_t>(y) * mWidth + x;
+            if (mSlot[p] == COMPRESSED) {
+                out[x] = mColor[p];
+                continue;
+            }
+            const auto *samples = mPools[tileOf(x, y)].data() + mSlot[p];
+            std::uint32_t sum[4] = { n / 2, n / 2, n / 2, n / 2 };
+            for (std::uint32_t i = 0; i < n; ++i) {
+                for (int c = 0; c < 4; ++c) {
+                    sum[c] += samples[i] >> (8 * c) & 0xff;
+                }
+            }
+            out[x] = sum[0] / n | (sum[1] / n) << 8 | (sum[2] / n) << 16 | (sum[3] / n) << 24;
+        }
+    });
+}
+
+MsaaBuffer::Stats MsaaBuffer::stats() const {
+    Stats res;
+    res.pixels = static_cast<long>(mSlot.size());
+    res.expanded = static_cast<long>(std::count_if(mSlot.begin(), mSlot.end(), [](std::uint32_t slot) { return slot != COMPRESSED; }));
+    res.bytes = (mDepth.size() + mColor.size() + mSlot.size()) * sizeof(std::uint32_t);
+    for (const auto& pool: mPools) {
+        res.bytes += pool.size() * sizeof(std::uint32_t);
+    }
+    return res;
+}
+
+int rasterizeMultisample(const TriangleSetup& s, const Rect& clip, MsaaBuffer& target, float *pixelDepth, const TGAColor& color) {
+    const Rect r{ std::max(s.bbox.x0, clip.x0), std::max(s.bbox.y0, clip.y0),
+                  std::min(s.bbox.x1, clip.x1), std::min(s.bbox.y1, clip.y1) };
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return 0;
+
+    // Edge values and depth of every sample relative to the pixel center. A
+    // pixel step is SUBPIXEL_ONE subpixel steps, so the edge offsets are exact.
+    const auto& pattern = target.pattern();
+    const auto n = pattern.count;
+    const auto full = (1u << n) - 1;
+    std::int64_t de[3][8];
+    std::int64_t lo[3], hi[3];
+    float dz[8];
+    for (int k = 0; k < 3; ++k) {
+        for (int i = 0; i < n; ++i) {
+            de[k][i] = (std::int64_t{ s.ex[k] } * pattern.offsets[i][0] + std::int64_t{ s.ey[k] } * pattern.offsets[i][1]) / SUBPIXEL_ONE;
+        }
+        lo[k] = *std::min_element(de[k], de[k] + n);
+        hi[k] = *std::max_element(de[k], de[k] + n);
+    }
+    for (int i = 0; i < n; ++i) {
+        dz[i] = (s.z.dx * pattern.offsets[i][0] + s.z.dy * pattern.offsets[i][1]) / SUBPIXEL_ONE;
+    }
+
+    const auto width = target.width();
+    auto written = 0;
+    auto tested = 0;
+    for (int y = r.y0; y < r.y1; ++y) {
+        const auto dy = y - s.bbox.y0;
+        std::int64_t e[3];
+        for (int k = 0; k < 3; ++k) {
+            e[k] = s.e0[k] + s.ey[k] * std::int64_t{ dy } + s.ex[k] * std::int64_t{ r.x0 - s.bbox.x0 };
+        }
+        const auto zRow = s.z.row(dy);
+        const auto ityRow = s.ity.row(dy);
+        for (int x = r.x0; x < r.x1; ++x, e[0] += s.ex[0], e[1] += s.ex[1], e[2] += s.ex[2]) {
+            // Most pixels are entirely outside one edge or entirely inside all three
+            if (e[0] + hi[0] < 0 || e[1] + hi[1] < 0 || e[2] + hi[2] < 0) continue;
+            auto covered = full;
+            if (e[0] + lo[0] < 0 || e[1] + lo[1] < 0 || e[2] + lo[2] < 0) {
+                covered = 0;
+                for (int i = 0; i < n; ++i) {
+                    if (((e[0] + de[0][i]) | (e[1] + de[1][i]) | (e[2] + de[2][i])) >= 0) covered |= 1u << i;
+                }
+                if (!covered) continue;
+            }
+            ++tested;
+
+            const auto dx = static_cast<float>(x - s.bbox.x0);
+            const auto z = zRow + s.z.dx * dx;
+            auto *depth = target.depth(x, y);
+            auto pass = 0u;
+            for (auto bits = covered; bits; bits &= bits - 1) {
+                const auto i = lowestBit(bits);
+                if (depth[i] < z + dz[i]) {
+                    depth[i] = z + dz[i];
+                    pass |= 1u << i;
+                }
+            }
+            if (!pass) continue;
+
+            pixelDepth[x + y * width] = *std::min_element(depth, depth + n);
+            // Shaded once, at the pixel center
+            const auto ity = ityRow + s.ity.dx * dx;
+            target.write(x, y, pass, Framebuffer::pack(color * ity) | Framebuffer::OPAQUE);
+            ++written;
+        }
+    }
+    profile::count(profile::Counter::FragmentsTested, tested);
+    return written;
+}
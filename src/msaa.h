@@ -0,0 +1,83 @@
+#ifndef MYRENDERER_MSAA_H
+#define MYRENDERER_MSAA_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "framebuffer.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+// Multisampling: coverage and depth are evaluated at 4 or 8 points of every
+// pixel, color once per pixel and triangle, and the resolve averages the
+// samples of a pixel into the output image.
+
+// Sample offsets from the pixel center in subpixels (1/16 pixel), the
+// standard 4x and 8x patterns, rotated so no two samples share a row or column
+struct SamplePattern {
+    int count;
+    int reach; // largest offset in x or y, the triangle setup margin
+    std::array<std::array<int, 2>, 8> offsets;
+};
+
+// Supported counts are 4 and 8
+[[nodiscard]] bool isSampleCount(int samples);
+[[nodiscard]] const SamplePattern& samplePattern(int samples);
+
+// Color and depth of every sample. Color is stored compressed: a pixel whose
+// samples all got the same triangle, which is every pixel off the triangle
+// edges, keeps one color. Only pixels on edges get a color per sample, in a
+// pool of the screen tile they are in, so tiles can be drawn in parallel the
+// way TileRenderer does as long as tileSize matches its tiles.
+class MsaaBuffer {
+public:
+    struct Stats {
+        long pixels = 0;
+        long expanded = 0;  // pixels holding a color per sample
+        std::size_t bytes = 0;
+    };
+
+    MsaaBuffer(int width, int height, int samples, int tileSize = 64);
+
+    void clear(std::uint32_t bgra = Framebuffer::BLACK);
+
+    [[nodiscard]] int width() const { return mWidth; }
+    [[nodiscard]] int height() const { return mHeight; }
+    [[nodiscard]] const SamplePattern& pattern() const { return mPattern; }
+    // samples() depths per pixel, pixels row by row
+    [[nodiscard]] float* depth() { return mDepth.data(); }
+    [[nodiscard]] float* depth(int x, int y) { return mDepth.data() + (static_cast<std::size_t>(y) * mWidth + x) * mPattern.count; }
+
+    // Sets the samples of (x, y) in mask to bgra, a full mask compresses the pixel again
+    void write(int x, int y, unsigned mask, std::uint32_t bgra);
+
+    // Averages the samples of every pixel into frame, which has the same size
+    void resolve(Framebuffer& frame, ThreadPool& pool) const;
+    // Memory in use and how many pixels are expanded, counts them so not for every frame
+    [[nodiscard]] Stats stats() const;
+
+private:
+    static constexpr std::uint32_t COMPRESSED = ~0u;
+
+    [[nodiscard]] int tileOf(int x, int y) const { return y / mTileSize * mTilesX + x / mTileSize; }
+
+    int mWidth;
+    int mHeight;
+    SamplePattern mPattern;
+    int mTileSize;
+    int mTilesX;
+    std::vector<float> mDepth;
+    std::vector<std::uint32_t> mColor;   // the color of compressed pixels
+    std::vector<std::uint32_t> mSlot;    // COMPRESSED or where the samples start in the tile's pool
+    std::vector<std::vector<std::uint32_t>> mPools;
+    unsigned mFullMask;
+};
+
+// Depth-tested multisampled Gouraud fill of s inside clip, s set up with the
+// pattern's reach as margin. pixelDepth gets the farthest sample depth of
+// each pixel for the coarse depth test. Returns the pixels with a sample that
+// passed the depth test.
+int rasterizeMultisample(const TriangleSetup& s, const Rect& clip, MsaaBuffer& target, float *pixelDepth, const TGAColor& color);
+
+#endif //MYRENDERER_MSAA_H
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include "mappedfile.h"
+#include "objparser.h"
+
+namespace {
+
+// Smaller files are not worth splitting
+const std::size_t MIN_CHUNK_SIZE = 1 << 20;
+
+struct Chunk {
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uv;
+    std::vector<Vec3f> norms;
+    std::vector<Vec3i> corners;
+    std::vector<int> faceSizes;
+    int ntriangles = 0;
+    // corner*3 + component of every negative index, they are counted from the
+    // start of the chunk until the chunk offsets are known
+    std::vector<int> relative;
+};
+
+inline const char* skipSpaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+const char* parseFloats(const char *p, const char *end, float *out, int n) {
+    for (int i = 0; i < n; ++i) {
+        p = skipSpaces(p, end);
+        if (p < end && *p == '+') ++p;
+        const auto res = std::from_chars(p, end, out[i]);
+        if (res.ec != std::errc{}) return p;
+        p = res.ptr;
+    }
+    return p;
+}
+
+// One v, v/vt, v//vn or v/vt/vn group
+const char* parseCorner(const char *p, const char *end, Chunk& chunk) {
+    Vec3i corner{ -1, -1, -1 };
+    const int counts[3] = { static_cast<int>(chunk.verts.size()),
+                            static_cast<int>(chunk.uv.size()),
+                            static_cast<int>(chunk.norms.size()) };
+    const auto cornerIdx = static_cast<int>(chunk.corners.size());
+    for (int k = 0; k < 3; ++k) {
+        if (k > 0) {
+            if (p >= end || *p != '/') break;
+            ++p;
+        }
+        auto idx = 0;
+        const auto res = std::from_chars(p, end, idx);
+        if (res.ec != std::errc{}) {
+            // No corner without a vertex, p stays put for the caller to see
+            if (k == 0) return p;
+            continue; // empty component as in v//vn
+        }
+        p = res.ptr;
+        if (idx > 0) {
+            corner[k] = idx - 1;
+        } else if (idx < 0) {
+            corner[k] = counts[k] + idx;
+            chunk.relative.push_back(cornerIdx * 3 + k);
+        }
+    }
+    chunk.corners.push_back(corner);
+    return p;
+}
+
+void parseChunk(const char *p, const char *end, Chunk& chunk) {
+    while (p < end) {
+        const auto *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        auto *line = skipSpaces(p, eol);
+        p = eol + 1;
+
+        if (eol - line < 2) continue;
+        float f[3] = { 0.f, 0.f, 0.f };
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            parseFloats(line + 2, eol, f, 3);
+            chunk.verts.emplace_back(f[0], f[1], f[2]);
+        } else if (line[0] == 'v' && line[1] == 't') {
+            parseFloats(line + 2, eol, f, 2);
+            chunk.uv.emplace_back(f[0], f[1]);
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            parseFloats(line + 2, eol, f, 3);
+            chunk.norms.emplace_back(f[0], f[1], f[2]);
+        } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            auto *q = line + 2;
+            auto size = 0;
+            const auto firstCorner = chunk.corners.size();
+            const auto firstRelative = chunk.relative.size();
+            for (q = skipSpaces(q, eol); q < eol && *q != '\r' && *q != '#'; q = skipSpaces(q, eol)) {
+                const auto *next = parseCorner(q, eol, chunk);
+                if (next == q) break; // garbage, drop the rest of the line
+                q = next;
+                ++size;
+            }
+            if (size < 3) {
+                // Not a polygon, none of its corners may shift the faces after it
+                chunk.corners.resize(firstCorner);
+                chunk.relative.resize(firstRelative);
+                continue;
+            }
+            chunk.faceSizes.push_back(size);
+            chunk.ntriangles += size - 2;
+        }
+    }
+}
+
+}
+
+bool loadObj(const std::string& filename, ThreadPool& pool, ObjMesh& mesh) {
+    const MappedFile file{ filename };
+    if (!file.isOpen()) {
+        return false;
+    }
+    const auto *data = file.data();
+    const auto size = file.size();
+
+    // Cut at line boundaries, every chunk starts right after a '\n'
+    const auto nchunks = static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(pool.size() * 4, size / MIN_CHUNK_SIZE)));
+    std::vector<std::size_t> bounds{ 0 };
+    for (int i = 1; i < nchunks; ++i) {
+        auto pos = std::max(bounds.back(), size * i / nchunks);
+        const auto *eol = pos < size ? static_cast<const char *>(std::memchr(data + pos, '\n', size - pos)) : nullptr;
+        pos = eol ? eol - data + 1 : size;
+        bounds.push_back(pos);
+    }
+    bounds.push_back(size);
+
+    std::vector<Chunk> chunks(nchunks);
+    pool.parallelFor(nchunks, [&](int i) {
+        parseChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+    });
+
+    // Chunk offsets into the merged arrays
+    struct Offsets { int verts, uv, norms, triangles; };
+    std::vector<Offsets> offsets(nchunks + 1, Offsets{});
+    for (int i = 0; i < nchunks; ++i) {
+        offsets[i + 1] = Offsets{ offsets[i].verts     + static_cast<int>(chunks[i].verts.size()),
+                                  offsets[i].uv        + static_cast<int>(chunks[i].uv.size()),
+                                  offsets[i].norms     + static_cast<int>(chunks[i].norms.size()),
+                                  offsets[i].triangles + chunks[i].ntriangles };
+    }
+    const auto& total = offsets.back();
+    mesh.verts.resize(total.verts);
+    mesh.uv.resize(total.uv);
+    mesh.norms.resize(total.norms);
+    mesh.vertIdx.resize(total.triangles * 3);
+    mesh.uvIdx.resize(total.triangles * 3);
+    mesh.normIdx.resize(total.triangles * 3);
+    mesh.bytes = size;
+
+    std::atomic<int> badVerts{ 0 };
+    pool.parallelFor(nchunks, [&](int i) {
+        auto& chunk = chunks[i];
+        const auto& off = offsets[i];
+        for (const auto r: chunk.relative) {
+            chunk.corners[r / 3][r % 3] += r % 3 == 0 ? off.verts : r % 3 == 1 ? off.uv : off.norms;
+        }
+        for (auto& c: chunk.corners) {
+            if (c.x < 0 || c.x >= total.verts) ++badVerts;
+            if (c.y >= total.uv) c.y = -1;
+            if (c.z >= total.norms) c.z = -1;
+            c.y = std::max(c.y, -1);
+            c.z = std::max(c.z, -1);
+        }
+        std::copy(chunk.verts.begin(),   chunk.verts.end(),   mesh.verts.begin()   + off.verts);
+        std::copy(chunk.uv.begin(),      chunk.uv.end(),      mesh.uv.begin()      + off.uv);
+        std::copy(chunk.norms.begin(),   chunk.norms.end(),   mesh.norms.begin()   + off.norms);
+
+        // Polygons become triangle fans around their first corner
+        auto out = off.triangles * 3;
+        const auto emit = [&](const Vec3i& c) {
+            mesh.vertIdx[out] = c.x;
+            mesh.uvIdx[out] = c.y;
+            mesh.normIdx[out] = c.z;
+            ++out;
+        };
+        const auto *face = chunk.corners.data();
+        for (const auto n: chunk.faceSizes) {
+            for (int k = 1; k + 1 < n; ++k) {
+                emit(face[0]);
+                emit(face[k]);
+                emit(face[k + 1]);
+            }
+            face += n;
+        }
+    });
+    if (badVerts) {
+        std::cerr << filename << ": " << badVerts << " face corners reference missing vertices\n";
+        // Nothing may render through those indices
+        mesh = ObjMesh{};
+        return false;
+    }
+    return true;
+}
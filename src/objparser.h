@@ -0,0 +1,32 @@
+#ifndef MYRENDERER_OBJPARSER_H
+#define MYRENDERER_OBJPARSER_H
+
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "threadpool.h"
+
+// Everything an OBJ file defines. Polygons are triangulated and their indices
+// made 0-based and absolute (negative OBJ indices are resolved), three per
+// triangle in separate position, uv and normal streams. Corners without a uv
+// or a normal reference store -1 there. A face line is read up to the first
+// token that is not a corner, faces left with fewer than 3 corners are dropped.
+struct ObjMesh {
+    std::vector<Vec3f> verts;
+    std::vector<Vec2f> uv;
+    std::vector<Vec3f> norms;
+    std::vector<int> vertIdx;
+    std::vector<int> uvIdx;
+    std::vector<int> normIdx;
+    std::size_t bytes = 0;       // size of the parsed file
+
+    [[nodiscard]] int nfaces() const { return static_cast<int>(vertIdx.size() / 3); }
+};
+
+// Memory-maps filename and parses it in line-aligned chunks on pool. Fails
+// with mesh left empty when the file can't be read or a face corner
+// references a missing vertex.
+bool loadObj(const std::string& filename, ThreadPool& pool, ObjMesh& mesh);
+
+#endif //MYRENDERER_OBJPARSER_H
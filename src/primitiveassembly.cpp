@@ -0,0 +1,69 @@
+#include <cmath>
+
+#include "clipper.h"
+#include "primitiveassembly.h"
+
+namespace {
+
+// Intensity, then the face weights of corners 1 and 2
+using Corner = ClipVertex<3>;
+
+const Vec2f CORNER_BARY[3] = { Vec2f{ 0, 0 }, Vec2f{ 1, 0 }, Vec2f{ 0, 1 } };
+
+}
+
+void PrimitiveAssembly::emit(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, const Primitive& prim) {
+    if (!mRenderer.submit(pts, ity, static_cast<std::uint32_t>(mPrimitives.size()))) return;
+    ++mStats.submitted;
+    mPrimitives.push_back(prim);
+    mPrimitives.back().area = std::abs(signedArea(pts[0], pts[1], pts[2])) * .5f;
+}
+
+void PrimitiveAssembly::submit(int face, const std::array<int, 3>& idx, const std::array<float, 3>& ity) {
+    ++mStats.triangles;
+    const auto c0 = mVertices.clipCode(idx[0]);
+    const auto c1 = mVertices.clipCode(idx[1]);
+    const auto c2 = mVertices.clipCode(idx[2]);
+    if (c0 & c1 & c2 & CLIP_FRUSTUM) {
+        ++mStats.outside;
+        return;
+    }
+    const auto planes = static_cast<std::uint8_t>((c0 | c1 | c2) & CLIP_NEEDED);
+    if (planes) {
+        clip(face, idx, ity, planes);
+        return;
+    }
+
+    const std::array<Vec3f, 3> pts{ mVertices.fetch(idx[0]), mVertices.fetch(idx[1]), mVertices.fetch(idx[2]) };
+    if (mCullBackFaces && signedArea(pts[0], pts[1], pts[2]) <= 0) {
+        ++mStats.backFacing;
+        return;
+    }
+    emit(pts, ity, Primitive{ face, { CORNER_BARY[0], CORNER_BARY[1], CORNER_BARY[2] }, 0.f });
+}
+
+void PrimitiveAssembly::clip(int face, const std::array<int, 3>& idx, const std::array<float, 3>& ity, std::uint8_t planes) {
+    Corner corners[3];
+    for (int i = 0; i < 3; ++i) {
+        corners[i] = Corner{ mVertices.fetchClip(idx[i]), { ity[i], CORNER_BARY[i].x, CORNER_BARY[i].y } };
+    }
+    Corner v[MAX_CLIP_VERTS];
+    const auto n = clipTriangle(corners, planes, v);
+    if (n < 3) {
+        ++mStats.outside;
+        return;
+    }
+
+    Vec3f screen[MAX_CLIP_VERTS];
+    const auto area = projectPolygon(v, n, screen);
+    if (mCullBackFaces && area <= 0) {
+        ++mStats.backFacing;
+        return;
+    }
+    ++mStats.clipped;
+    const auto bary = [](const Corner& c) { return Vec2f{ c.v[1], c.v[2] }; };
+    for (int i = 1; i + 1 < n; ++i) {
+        emit({ screen[0], screen[i], screen[i + 1] }, { v[0].v[0], v[i].v[0], v[i + 1].v[0] },
+             Primitive{ face, { bary(v[0]), bary(v[i]), bary(v[i + 1]) }, 0.f });
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef MYRENDERER_PRIMITIVEASSEMBLY_H
+#define MYRENDERER_PRIMITIVEASSEMBLY_H
+
+#include <array>
+#include <vector>
+
+#include "tilerenderer.h"
+#include "vertexstage.h"
+
+// Turns indexed faces into screen-space triangles for the tile renderer.
+// Back faces and triangles outside the view frustum are dropped, triangles
+// crossing the near plane or the guard band are clipped in homogeneous space,
+// so everything that reaches triangle setup is in front of the eye and small
+// enough for its fixed-point edge functions.
+// Every submitted triangle gets the index of its Primitive as renderer id.
+
+// Where a submitted triangle lies on the face it came from: the face weights
+// of the second and third face corner at each of its vertices
+struct Primitive {
+    int face;
+    Vec2f bary[3];
+    float area;  // screen area of the submitted triangle in pixels, picks the mip level
+};
+
+class PrimitiveAssembly {
+public:
+    // Per frame, clipped triangles can turn into several submitted ones
+    struct Stats {
+        long triangles = 0;  // faces seen
+        long backFacing = 0;
+        long outside = 0;    // outside the frustum
+        long clipped = 0;
+        long submitted = 0;  // triangles handed to the renderer
+
+        [[nodiscard]] long culled() const { return backFacing + outside; }
+    };
+
+    PrimitiveAssembly(VertexStage& vertices, TileRenderer& renderer, bool cullBackFaces = true)
+        : mVertices(vertices), mRenderer(renderer), mCullBackFaces(cullBackFaces) {}
+
+    // idx are the vertex stage indices of the corners of face, ity their intensities
+    void submit(int face, const std::array<int, 3>& idx, const std::array<float, 3>& ity);
+    void clear() { mStats = Stats{}; mPrimitives.clear(); }
+
+    [[nodiscard]] const Stats& stats() const { return mStats; }
+    [[nodiscard]] const std::vector<Primitive>& primitives() const { return mPrimitives; }
+
+private:
+    void clip(int face, const std::array<int, 3>& idx, const std::array<float, 3>& ity, std::uint8_t planes);
+    void emit(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, const Primitive& prim);
+
+    VertexStage& mVertices;
+    TileRenderer& mRenderer;
+    bool mCullBackFaces;
+    Stats mStats;
+    std::vector<Primitive> mPrimitives;
+};
+
+#endif //MYRENDERER_PRIMITIVEASSEMBLY_H
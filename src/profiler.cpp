@@ -0,0 +1,216 @@
+#include "profiler.h"
+
+#if MYRENDERER_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace profile {
+
+namespace {
+
+constexpr auto NCOUNTERS = static_cast<std::size_t>(Counter::COUNT);
+using Counts = std::array<std::int64_t, NCOUNTERS>;
+
+struct Event {
+    const char *name;
+    std::int64_t start, end; // ns
+};
+
+struct ThreadLog {
+    int id;
+    std::string name;
+    std::vector<Event> events;
+    // Other threads take these at the end of a frame while this one may be counting
+    std::array<std::atomic<std::int64_t>, NCOUNTERS> counters{};
+};
+
+struct FrameRecord {
+    std::int64_t end;
+    Counts counts;
+};
+
+const auto epoch = std::chrono::steady_clock::now();
+
+std::mutex logsMutex;
+// Logs outlive their threads, the events of a finished worker still get exported
+std::vector<std::unique_ptr<ThreadLog>> logs;
+std::vector<FrameRecord> frames;
+long endedFrames = 0;
+
+ThreadLog& threadLog() {
+    thread_local ThreadLog *log = [] {
+        std::lock_guard<std::mutex> lock{ logsMutex };
+        logs.push_back(std::make_unique<ThreadLog>());
+        logs.back()->id = static_cast<int>(logs.size());
+        logs.back()->name = "thread " + std::to_string(logs.size());
+        return logs.back().get();
+    }();
+    return *log;
+}
+
+// Takes what every thread counted so far, logsMutex must be held
+Counts takeCounts() {
+    Counts res{};
+    for (const auto& log: logs) {
+        for (std::size_t i = 0; i < NCOUNTERS; ++i) {
+            res[i] += log->counters[i].exchange(0, std::memory_order_relaxed);
+        }
+    }
+    return res;
+}
+
+// Whatever was counted after the last endFrame(), e.g. the final write, gets a record of its own
+void closeCounts() {
+    const auto counts = takeCounts();
+    if (std::any_of(counts.begin(), counts.end(), [](std::int64_t n) { return n != 0; })) {
+        frames.push_back(FrameRecord{ detail::now(), counts });
+    }
+}
+
+std::int64_t at(const Counts& counts, Counter counter) {
+    return counts[static_cast<std::size_t>(counter)];
+}
+
+double overdraw(const Counts& counts) {
+    const auto covered = at(counts, Counter::PixelsCovered);
+    return covered ? static_cast<double>(at(counts, Counter::FragmentsWritten)) / covered : 0.;
+}
+
+}
+
+namespace detail {
+
+std::atomic<bool> enabled{ false };
+
+std::int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char *name, std::int64_t start, std::int64_t end) {
+    threadLog().events.push_back(Event{ name, start, end });
+}
+
+void add(Counter counter, std::int64_t n) {
+    threadLog().counters[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+}
+
+void setEnabled(bool on) {
+    detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+void setThreadName(const std::string& name) {
+    threadLog().name = name;
+}
+
+void endFrame() {
+    if (!enabled()) return;
+    const auto end = detail::now();
+    std::lock_guard<std::mutex> lock{ logsMutex };
+    frames.push_back(FrameRecord{ end, takeCounts() });
+    ++endedFrames;
+}
+
+std::string summary() {
+    std::lock_guard<std::mutex> lock{ logsMutex };
+    closeCounts();
+    Counts total{};
+    for (const auto& f: frames) {
+        for (std::size_t i = 0; i < NCOUNTERS; ++i) {
+            total[i] += f.counts[i];
+        }
+    }
+
+    // Time per scope name, in the order the names first appear
+    struct Stage {
+        std::string name;
+        std::int64_t first;
+        std::int64_t ns;
+    };
+    std::vector<Stage> stages;
+    for (const auto& log: logs) {
+        for (const auto& e: log->events) {
+            auto it = std::find_if(stages.begin(), stages.end(), [&](const Stage& s) { return s.name == e.name; });
+            if (it == stages.end()) {
+                stages.push_back(Stage{ e.name, e.start, 0 });
+                it = stages.end() - 1;
+            }
+            it->first = std::min(it->first, e.start);
+            it->ns += e.end - e.start;
+        }
+    }
+    std::stable_sort(stages.begin(), stages.end(), [](const Stage& a, const Stage& b) { return a.first < b.first; });
+
+    std::ostringstream s;
+    s << "Profile: " << endedFrames << (endedFrames == 1 ? " frame" : " frames");
+    for (const auto& stage: stages) {
+        s << ", " << stage.name << ' ' << stage.ns / 1e6;
+    }
+    s << " ms; triangles " << at(total, Counter::TrianglesSubmitted) << " submitted, " << at(total, Counter::TrianglesCulled)
+      << " culled, " << at(total, Counter::TrianglesRasterized) << " rasterized; fragments "
+      << at(total, Counter::FragmentsTested) << " tested, " << at(total, Counter::FragmentsWritten)
+      << " written, overdraw " << overdraw(total) << "; " << at(total, Counter::BytesWritten) / 1e6 << " MB written";
+    return s.str();
+}
+
+bool writeChromeTrace(const std::string& filename) {
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> out{ std::fopen(filename.c_str(), "wb"), std::fclose };
+    if (!out) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock{ logsMutex };
+    closeCounts();
+    auto *f = out.get();
+    // Timestamps are microseconds
+    std::fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", f);
+    auto first = true;
+    const auto separator = [&] {
+        std::fputs(first ? "  " : ",\n  ", f);
+        first = false;
+    };
+    for (const auto& log: logs) {
+        separator();
+        std::fprintf(f, R"({"ph": "M", "name": "thread_name", "pid": 1, "tid": %d, "args": {"name": "%s"}})", log->id, log->name.c_str());
+        for (const auto& e: log->events) {
+            separator();
+            std::fprintf(f, R"({"ph": "X", "name": "%s", "pid": 1, "tid": %d, "ts": %.3f, "dur": %.3f})",
+                         e.name, log->id, e.start / 1e3, (e.end - e.start) / 1e3);
+        }
+    }
+    for (const auto& frame: frames) {
+        const auto& c = frame.counts;
+        const auto ts = frame.end / 1e3;
+        separator();
+        std::fprintf(f, R"({"ph": "C", "name": "triangles", "pid": 1, "ts": %.3f, "args": {"submitted": %lld, "culled": %lld, "rasterized": %lld}})",
+                     ts, static_cast<long long>(at(c, Counter::TrianglesSubmitted)), static_cast<long long>(at(c, Counter::TrianglesCulled)),
+                     static_cast<long long>(at(c, Counter::TrianglesRasterized)));
+        separator();
+        std::fprintf(f, R"({"ph": "C", "name": "fragments", "pid": 1, "ts": %.3f, "args": {"tested": %lld, "written": %lld}})",
+                     ts, static_cast<long long>(at(c, Counter::FragmentsTested)), static_cast<long long>(at(c, Counter::FragmentsWritten)));
+        separator();
+        std::fprintf(f, R"({"ph": "C", "name": "overdraw", "pid": 1, "ts": %.3f, "args": {"overdraw": %.3f}})", ts, overdraw(c));
+        separator();
+        std::fprintf(f, R"({"ph": "C", "name": "bytes written", "pid": 1, "ts": %.3f, "args": {"bytes": %lld}})",
+                     ts, static_cast<long long>(at(c, Counter::BytesWritten)));
+    }
+    std::fputs("\n]}\n", f);
+    if (std::ferror(f)) {
+        std::cerr << "can't write the trace " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef MYRENDERER_PROFILER_H
+#define MYRENDERER_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped timers and counters for finding out where the time of a frame goes.
+// Building with MYRENDERER_PROFILE=0 compiles all of it out. Otherwise it
+// stays off until setEnabled(true), a disabled scope or counter costs one
+// relaxed load.
+//
+// Every thread records into a log of its own. summary() and
+// writeChromeTrace() read all logs, so they must run while no other thread
+// records, e.g. once the renderer and the frame sink are done.
+
+#ifndef MYRENDERER_PROFILE
+#define MYRENDERER_PROFILE 1
+#endif
+
+namespace profile {
+
+enum class Counter {
+    TrianglesSubmitted,  // faces handed to primitive assembly
+    TrianglesCulled,     // of those, back-facing or outside the frustum
+    TrianglesRasterized, // set up and binned
+    FragmentsTested,     // covered pixels that reached the depth test
+    FragmentsWritten,    // and passed it
+    PixelsCovered,       // distinct pixels a frame drew, overdraw is written / covered
+    BytesWritten,        // images and frames written out
+    COUNT
+};
+
+#if MYRENDERER_PROFILE
+
+namespace detail {
+extern std::atomic<bool> enabled;
+std::int64_t now();
+void record(const char *name, std::int64_t start, std::int64_t end);
+void add(Counter counter, std::int64_t n);
+}
+
+inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool on);
+// How the calling thread shows up in the trace
+void setThreadName(const std::string& name);
+
+inline void count(Counter counter, std::int64_t n) {
+    if (enabled()) detail::add(counter, n);
+}
+
+// Closes a frame: the counters since the last endFrame() become its values
+void endFrame();
+
+// One line: frames, time per scope name and the counter totals
+std::string summary();
+// Chrome trace event format, for chrome://tracing or ui.perfetto.dev
+bool writeChromeTrace(const std::string& filename);
+
+// Times the enclosing scope, name must be a string literal
+class Scope {
+public:
+    explicit Scope(const char *name) {
+        if (enabled()) {
+            mName = name;
+            mStart = detail::now();
+        }
+    }
+    ~Scope() {
+        if (mName) detail::record(mName, mStart, detail::now());
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char *mName = nullptr;
+    std::int64_t mStart = 0;
+};
+
+#else
+
+constexpr bool enabled() { return false; }
+inline void setEnabled(bool) {}
+inline void setThreadName(const std::string&) {}
+inline void count(Counter, std::int64_t) {}
+inline void endFrame() {}
+inline std::string summary() { return "Profile: not built in, configure with MYRENDERER_PROFILING=ON"; }
+inline bool writeChromeTrace(const std::string&) { return false; }
+
+class Scope {
+public:
+    explicit Scope(const char *) {}
+};
+
+#endif
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) profile::Scope PROFILE_CONCAT(profileScope, __LINE__){ name }
+
+#endif //MYRENDERER_PROFILER_H
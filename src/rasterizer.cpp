@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "rasterizer.h"
+#include "rasterloop.h"
+
+void line(Vec2i p0, Vec2i p1, TGAImage& image, const TGAColor& color) {
+    auto x0 = p0.x;
+    auto x1 = p1.x;
+    auto y0 = p0.y;
+    auto y1 = p1.y;
+
+    auto steep = false;
+    if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+        steep = true;
+    }
+
+    if (x0 > x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    const auto dx = x1 - x0;
+    const auto dy = y1 - y0;
+    const auto derror2 = std::abs(dy) * 2;
+    auto error2 = 0;
+    auto y = y0;
+
+    for (int x = x0; x < x1; ++x) {
+        if (steep) {
+            image.set(y, x, color);
+        } else {
+            image.set(x, y, color);
+        }
+        error2 += derror2;
+        if (error2 > dx) {
+            y += (y1 > y0 ? 1 : -1);
+            error2 -= dx *2;
+        }
+    }
+}
+
+Vec3f barycentric(const std::array<Vec3f, 3>& pts, Vec3f p) {
+    const auto u = Vec3f{ static_cast<float>(pts[2].x - pts[0].x),
+                          static_cast<float>(pts[1].x - pts[0].x),
+                          static_cast<float>(pts[0].x - p.x) } ^
+                   Vec3f{ static_cast<float>(pts[2].y - pts[0].y),
+                          static_cast<float>(pts[1].y - pts[0].y),
+                          static_cast<float>(pts[0].y - p.y) };
+
+    if (std::abs(u.z) < 1) {
+        return Vec3f{ -1, 1, 1 };
+    }
+    return Vec3f{ 1.f - (u.x + u.y)/u.z, u.x/u.z, u.y/u.z };
+}
+
+bool setupTriangle(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, const Rect& viewport, TriangleSetup& s,
+                   int margin) {
+    std::int64_t X[3], Y[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!(std::abs(pts[i].x) < GUARD_BAND && std::abs(pts[i].y) < GUARD_BAND)) return false;
+        X[i] = std::lround(pts[i].x * SUBPIXEL_ONE);
+        Y[i] = std::lround(pts[i].y * SUBPIXEL_ONE);
+    }
+
+    // Counter-clockwise triangles keep their order, clockwise ones swap two
+    // vertices so that every edge function is positive inside
+    int order[3] = { 0, 1, 2 };
+    auto area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+    if (area == 0) return false;
+    if (area < 0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    const auto minX = std::min({ X[0], X[1], X[2] });
+    const auto maxX = std::max({ X[0], X[1], X[2] });
+    const auto minY = std::min({ Y[0], Y[1], Y[2] });
+    const auto maxY = std::max({ Y[0], Y[1], Y[2] });
+    // Pixel x is sampled at its center x*16+8, keep only pixels whose center, give or
+    // take margin, lies in the bbox
+    const auto lo = SUBPIXEL_ONE / 2 + margin;
+    const auto hi = SUBPIXEL_ONE / 2 - margin;
+    s.bbox.x0 = std::max(viewport.x0, static_cast<int>((minX - lo + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    s.bbox.y0 = std::max(viewport.y0, static_cast<int>((minY - lo + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    s.bbox.x1 = std::min(viewport.x1, static_cast<int>(((maxX - hi) >> SUBPIXEL_BITS) + 1));
+    s.bbox.y1 = std::min(viewport.y1, static_cast<int>(((maxY - hi) >> SUBPIXEL_BITS) + 1));
+    if (s.bbox.x0 >= s.bbox.x1 || s.bbox.y0 >= s.bbox.y1) return false;
+
+    const auto px = static_cast<std::int64_t>(s.bbox.x0) * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+    const auto py = static_cast<std::int64_t>(s.bbox.y0) * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+    double e[3];
+    for (int i = 0; i < 3; ++i) {
+        // Edge function of the edge opposite to vertex i, it is the weight of i times area
+        const auto j = order[(i + 1) % 3];
+        const auto k = order[(i + 2) % 3];
+        const auto dx = X[k] - X[j];
+        const auto dy = Y[k] - Y[j];
+        const auto value = dx * (py - Y[j]) - dy * (px - X[j]);
+        e[i] = static_cast<double>(value);
+        // Top-left rule: a pixel center exactly on an edge belongs to the triangle only
+        // when that edge is a top or a left one, so shared edges are drawn once
+        const auto topLeft = dy < 0 || (dy == 0 && dx < 0);
+        s.e0[i] = topLeft ? value : value - 1;
+        s.ex[i] = static_cast<std::int32_t>(-dy * SUBPIXEL_ONE);
+        s.ey[i] = static_cast<std::int32_t>(dx * SUBPIXEL_ONE);
+    }
+
+    // Edge values are linear, so checking the bbox corners tells whether
+    // stepping them in 32 bit lanes can overflow
+    const auto w = s.bbox.x1 - s.bbox.x0 - 1;
+    const auto h = s.bbox.y1 - s.bbox.y0 - 1;
+    s.narrow = true;
+    for (int i = 0; i < 3; ++i) {
+        for (const auto c: { s.e0[i], s.e0[i] + s.ex[i] * std::int64_t{ w }, s.e0[i] + s.ey[i] * std::int64_t{ h },
+                             s.e0[i] + s.ex[i] * std::int64_t{ w } + s.ey[i] * std::int64_t{ h } }) {
+            s.narrow = s.narrow && c > INT32_MIN / 2 && c < INT32_MAX / 2;
+        }
+    }
+
+    const auto invArea = 1. / static_cast<double>(area);
+    const auto plane = [&](float a0, float a1, float a2) {
+        const auto d1 = static_cast<double>(a1 - a0) * invArea;
+        const auto d2 = static_cast<double>(a2 - a0) * invArea;
+        return Plane{ static_cast<float>(a0 + e[1] * d1 + e[2] * d2),
+                      static_cast<float>(s.ex[1] * d1 + s.ex[2] * d2),
+                      static_cast<float>(s.ey[1] * d1 + s.ey[2] * d2) };
+    };
+    s.invArea = static_cast<float>(invArea);
+    s.swapped = order[1] != 1;
+    s.z   = plane(pts[order[0]].z, pts[order[1]].z, pts[order[2]].z);
+    s.ity = plane(ity[order[0]],   ity[order[1]],   ity[order[2]]);
+    // Slack for the rounding of the plane evaluation, the bound must never be below a pixel
+    const auto zmax = std::max({ pts[0].z, pts[1].z, pts[2].z });
+    s.zmax = zmax + 1e-3f * (1.f + std::abs(zmax));
+    return true;
+}
+
+namespace {
+
+// Fragment writers, called for every pixel that passed the depth test
+
+struct ShadeFragment {
+    const TriangleSetup& s;
+    Framebuffer& frame;
+    const TGAColor& color;
+
+    void operator()(int x, int y) const {
+        const auto ity = s.ity.row(y - s.bbox.y0) + s.ity.dx * static_cast<float>(x - s.bbox.x0);
+        frame.set(x, y, Framebuffer::pack(color * ity) | Framebuffer::OPAQUE);
+    }
+};
+
+struct VisibilityFragment {
+    const TriangleSetup& s;
+    std::uint32_t id;
+    VisibilitySample *vis;
+    int width;
+
+    void operator()(int x, int y) const {
+        // The edge function opposite to a vertex is its weight times the area
+        const auto dx = std::int64_t{ x - s.bbox.x0 };
+        const auto dy = std::int64_t{ y - s.bbox.y0 };
+        const auto w1 = static_cast<float>(s.e0[1] + s.ex[1] * dx + s.ey[1] * dy) * s.invArea;
+        const auto w2 = static_cast<float>(s.e0[2] + s.ex[2] * dx + s.ey[2] * dy) * s.invArea;
+        const auto unorm = [](float w) {
+            return static_cast<std::uint16_t>(std::max(0.f, std::min(1.f, w)) * VisibilitySample::ONE + .5f);
+        };
+        // Clockwise triangles had their last two vertices swapped by setup
+        vis[x + y * width] = s.swapped ? VisibilitySample{ id, unorm(w2), unorm(w1) }
+                                       : VisibilitySample{ id, unorm(w1), unorm(w2) };
+    }
+};
+
+}
+
+int rasterize(const TriangleSetup& s, const Rect& clip, float *zbuffer, Framebuffer& frame, const TGAColor& color) {
+    return rasterizeWith(s, clip, zbuffer, frame.width(), ShadeFragment{ s, frame, color });
+}
+
+int rasterizeVisibility(const TriangleSetup& s, std::uint32_t id, const Rect& clip, float *zbuffer, VisibilitySample *vis, int width) {
+    return rasterizeWith(s, clip, zbuffer, width, VisibilityFragment{ s, id, vis, width });
+}
+
+int rasterizeDepth(const TriangleSetup& s, const Rect& clip, float *zbuffer, int width) {
+    return rasterizeWith(s, clip, zbuffer, width, DepthOnlyFragment{});
+}
+
+void triangle(std::array<Vec3f, 3>& pts, float *buffer, Framebuffer& frame, const TGAColor& color) {
+    const Rect viewport{ 0, 0, frame.width(), frame.height() };
+    TriangleSetup s;
+    if (setupTriangle(pts, { 1.f, 1.f, 1.f }, viewport, s)) {
+        rasterize(s, viewport, buffer, frame, color);
+    }
+}
+
+void triangleOld(std::array<Vec3i, 3>& v, std::array<float, 3>& ity, TGAImage& image, int *buffer, const Rect& clip) {
+
+    if (v[0].y == v[1].y && v[0].y == v[2].y) return; // i dont care about degenerate triangles
+
+    if (v[0].y > v[1].y) { std::swap(v[0], v[1]); std::swap(ity[0], ity[1]); }
+    if (v[0].y > v[2].y) { std::swap(v[0], v[2]); std::swap(ity[0], ity[2]); }
+    if (v[1].y > v[2].y) { std::swap(v[1], v[2]); std::swap(ity[1], ity[2]); }
+
+    const auto width = image.get_width();
+    const auto totalHeight = v[2].y - v[0].y;
+    // Only walk the rows and spans that overlap clip, the interpolation itself
+    // does not depend on where we start so the result is the same as a full walk
+    const auto rowBegin = std::max(0, clip.y0 - v[0].y);
+    const auto rowEnd = std::min(totalHeight, clip.y1 - v[0].y);
+    for (int i=rowBegin; i < rowEnd; i++) {
+        const auto secondHalf = i > v[1].y - v[0].y || v[1].y == v[0].y;
+        const auto segmentHeight = secondHalf ? v[2].y - v[1].y : v[1].y - v[0].y;
+        const auto alpha = static_cast<float>(i) / totalHeight;
+        const auto beta  = static_cast<float>(i - (secondHalf ? v[1].y - v[0].y : 0)) / segmentHeight;
+        auto A   =               v[0]  + Vec3f{ v[2] - v[0] } * alpha;
+        auto B   = secondHalf ? v[1] + Vec3f{ v[2] - v[1] } * beta : v[0] + Vec3f{ v[1] - v[0]  } * beta;
+        auto ityA = ity[0] + (ity[2] - ity[0]) * alpha;
+        auto ityB = secondHalf ? ity[1] + (ity[2] - ity[1]) * beta : ity[0] + (ity[1] - ity[0]) * beta;
+        if (A.x > B.x) { std::swap(A, B); std::swap(ityA, ityB); }
+        const auto y = v[0].y + i;
+        const auto spanEnd = std::min(B.x, clip.x1 - 1);
+        for (int j = std::max(A.x, clip.x0); j <= spanEnd; j++) {
+            const auto phi = B.x == A.x ? 1. : static_cast<float>(j - A.x)/static_cast<float>(B.x - A.x);
+            const auto   P = Vec3f{ A }  + Vec3f{ B - A } * phi;
+            const auto ityP = ityA + (ityB - ityA) * phi;
+            const auto idx = j + y * width;
+            if (buffer[idx] < P.z) {
+                buffer[idx] = P.z;
+                image.set(j, y, TGAColor{255, 255, 255} * ityP);
+            }
+        }
+    }
+}
+
+void triangleOld(std::array<Vec3i, 3>& v, std::array<float, 3>& ity, TGAImage& image, int *buffer) {
+    triangleOld(v, ity, image, buffer, Rect{ 0, 0, image.get_width(), image.get_height() });
+}
@@ -0,0 +1,80 @@
+#ifndef MYRENDERER_RASTERIZER_H
+#define MYRENDERER_RASTERIZER_H
+
+#include <array>
+#include <cstdint>
+
+#include "framebuffer.h"
+#include "geometry.h"
+#include "../dependencies/tgaimage.h"
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1)
+struct Rect {
+    int x0, y0, x1, y1;
+};
+
+// Vertices are snapped to 28.4 fixed point before rasterization
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+// Triangles reaching further out than this are dropped instead of overflowing the setup,
+// primitive assembly clips everything well inside it
+constexpr float GUARD_BAND = 1 << 14;
+
+// Attribute interpolated linearly over a triangle, value = c + dx*x + dy*y
+// with x, y counted in pixels from the triangle bbox origin. It is always
+// evaluated row first so the result at a pixel does not depend on traversal.
+struct Plane {
+    float c, dx, dy;
+
+    [[nodiscard]] float row(int y) const { return c + dy * static_cast<float>(y); }
+};
+
+// Everything the rasterizer needs about one triangle, built once by setupTriangle()
+struct TriangleSetup {
+    Rect bbox;               // covered pixels, already clamped to the viewport
+    std::int64_t e0[3];      // edge functions at the first bbox pixel center, fill rule applied
+    std::int32_t ex[3];      // edge function steps per pixel in x
+    std::int32_t ey[3];      // and in y
+    bool narrow;             // every edge value inside bbox fits into 32 bits
+    bool swapped;            // vertices 1 and 2 were swapped to make the triangle counter-clockwise
+    float invArea;           // 1 / twice the area in fixed point units, turns edge values into weights
+    Plane z;
+    Plane ity;
+    float zmax;              // no covered pixel gets a larger depth
+};
+
+// Snaps pts to fixed point and builds the edge and attribute equations.
+// Returns false for zero-area triangles and triangles that miss viewport.
+// bbox takes the pixels that have a point at most margin subpixels from their
+// center inside the triangle's bounds, multisampling needs its sample offsets there.
+bool setupTriangle(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, const Rect& viewport, TriangleSetup& s,
+                   int margin = 0);
+// Pixel of a visibility buffer: the triangle drawn there and the weights of
+// its second and third vertex, the first one gets what is left
+struct VisibilitySample {
+    static constexpr std::uint32_t EMPTY = ~0u;
+    static constexpr float ONE = 65535.f; // weight 1 in b1, b2
+
+    std::uint32_t id;
+    std::uint16_t b1, b2;
+};
+
+// Depth-tested Gouraud fill of the pixels of s inside clip, steps the edge functions with integer adds.
+// Returns the number of pixels that passed the depth test.
+int rasterize(const TriangleSetup& s, const Rect& clip, float *zbuffer, Framebuffer& frame, const TGAColor& color);
+// Same traversal and depth test, but visible pixels only get id and barycentrics
+// stored into vis, a width pixels wide buffer like zbuffer
+int rasterizeVisibility(const TriangleSetup& s, std::uint32_t id, const Rect& clip, float *zbuffer, VisibilitySample *vis, int width);
+// Depth only, for shadow maps and depth prepasses: no attribute is interpolated
+int rasterizeDepth(const TriangleSetup& s, const Rect& clip, float *zbuffer, int width);
+
+void line(Vec2i p0, Vec2i p1, TGAImage& image, const TGAColor& color);
+
+Vec3f barycentric(const std::array<Vec3f, 3>& pts, Vec3f p);
+void triangle(std::array<Vec3f, 3>& pts, float *buffer, Framebuffer& frame, const TGAColor& color);
+
+// Scanline Gouraud rasterizer the pipeline used before the fixed-point one, only pixels inside clip are touched
+void triangleOld(std::array<Vec3i, 3>& v, std::array<float, 3>& ity, TGAImage& image, int *buffer, const Rect& clip);
+void triangleOld(std::array<Vec3i, 3>& v, std::array<float, 3>& ity, TGAImage& image, int *buffer);
+
+#endif //MYRENDERER_RASTERIZER_H
@@ -0,0 +1,195 @@
+#ifndef MYRENDERER_RASTERLOOP_H
+#define MYRENDERER_RASTERLOOP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "profiler.h"
+#include "rasterizer.h"
+#include "simd.h"
+
+// Pixel traversal of a set-up triangle, templated on what happens to a pixel
+// that passes the depth test. fragment(x, y) is called once per such pixel,
+// after its depth was stored, and is inlined into every SIMD kernel, so each
+// kind of fragment gets its own specialized loops without an indirect call.
+// The pixels reaching the depth test are counted per call for the profiler.
+//
+// Larger depth is nearer. A pixel passes when it is nearer than what the
+// z-buffer holds, or with DepthTest::GreaterEqual also when it is at the same
+// depth, which lets the pass after a depth prepass shade exactly the pixels
+// the prepass left its own depth in.
+
+enum class DepthTest {
+    Greater,
+    GreaterEqual
+};
+
+// Depth-only passes (shadow maps, depth prepasses) pass this, the kernels then
+// neither interpolate nor visit the passing pixels but just count them
+struct DepthOnlyFragment {
+    void operator()(int, int) const {}
+};
+
+template <class Fragment>
+inline int emitFragments(const Fragment& fragment, int x, int y, unsigned bits) {
+    if constexpr (std::is_same_v<Fragment, DepthOnlyFragment>) {
+        return bitCount(bits);
+    } else {
+        auto written = 0;
+        for (; bits; bits &= bits - 1) {
+            fragment(x + lowestBit(bits), y);
+            ++written;
+        }
+        return written;
+    }
+}
+
+template <DepthTest TEST, class Fragment>
+int rasterizeScalar(const TriangleSetup& s, const Rect& r, int xfrom, float *zbuffer, int width, const Fragment& fragment) {
+    auto written = 0;
+    auto tested = 0;
+    for (int y = r.y0; y < r.y1; ++y) {
+        const auto dy = y - s.bbox.y0;
+        std::int64_t e[3];
+        for (int k = 0; k < 3; ++k) {
+            e[k] = s.e0[k] + s.ey[k] * std::int64_t{ dy } + s.ex[k] * std::int64_t{ xfrom - s.bbox.x0 };
+        }
+        const auto zRow = s.z.row(dy);
+        for (int x = xfrom; x < r.x1; ++x, e[0] += s.ex[0], e[1] += s.ex[1], e[2] += s.ex[2]) {
+            if ((e[0] | e[1] | e[2]) < 0) continue;
+            ++tested;
+            const auto z = zRow + s.z.dx * static_cast<float>(x - s.bbox.x0);
+            const auto idx = x + y * width;
+            if (TEST == DepthTest::Greater ? zbuffer[idx] < z : zbuffer[idx] <= z) {
+                zbuffer[idx] = z;
+                fragment(x, y);
+                ++written;
+            }
+        }
+    }
+    profile::count(profile::Counter::FragmentsTested, tested);
+    return written;
+}
+
+#ifdef MYRENDERER_X86
+// 4x1 pixel blocks, the ragged right end of each row goes through the scalar code
+template <DepthTest TEST, class Fragment>
+MYRENDERER_TARGET("sse2")
+int rasterizeSSE2(const TriangleSetup& s, const Rect& r, float *zbuffer, int width, const Fragment& fragment) {
+    auto written = 0;
+    auto tested = 0;
+    const auto blockEnd = r.x0 + ((r.x1 - r.x0) & ~3);
+    __m128i lanes[3], step[3];
+    for (int k = 0; k < 3; ++k) {
+        lanes[k] = _mm_setr_epi32(0, s.ex[k], 2 * s.ex[k], 3 * s.ex[k]);
+        step[k] = _mm_set1_epi32(4 * s.ex[k]);
+    }
+    const auto zdx = _mm_set1_ps(s.z.dx);
+    for (int y = r.y0; y < r.y1; ++y) {
+        const auto dy = y - s.bbox.y0;
+        __m128i e[3];
+        for (int k = 0; k < 3; ++k) {
+            const auto start = s.e0[k] + s.ey[k] * std::int64_t{ dy } + s.ex[k] * std::int64_t{ r.x0 - s.bbox.x0 };
+            e[k] = _mm_add_epi32(_mm_set1_epi32(static_cast<std::int32_t>(start)), lanes[k]);
+        }
+        const auto zRow = _mm_set1_ps(s.z.row(dy));
+        auto dx = _mm_setr_ps(0, 1, 2, 3);
+        dx = _mm_add_ps(dx, _mm_set1_ps(static_cast<float>(r.x0 - s.bbox.x0)));
+        for (int x = r.x0; x < blockEnd; x += 4) {
+            const auto outside = _mm_or_si128(_mm_or_si128(e[0], e[1]), e[2]);
+            const auto inside = _mm_castsi128_ps(_mm_cmpgt_epi32(outside, _mm_set1_epi32(-1)));
+            if (const auto covered = _mm_movemask_ps(inside)) {
+                tested += bitCount(covered);
+                auto *depth = zbuffer + x + y * width;
+                const auto z = _mm_add_ps(zRow, _mm_mul_ps(zdx, dx));
+                const auto old = _mm_loadu_ps(depth);
+                const auto nearer = TEST == DepthTest::Greater ? _mm_cmplt_ps(old, z) : _mm_cmple_ps(old, z);
+                const auto pass = _mm_and_ps(inside, nearer);
+                if (const auto bits = _mm_movemask_ps(pass)) {
+                    _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+                    written += emitFragments(fragment, x, y, bits);
+                }
+            }
+            for (int k = 0; k < 3; ++k) {
+                e[k] = _mm_add_epi32(e[k], step[k]);
+            }
+            dx = _mm_add_ps(dx, _mm_set1_ps(4));
+        }
+    }
+    profile::count(profile::Counter::FragmentsTested, tested);
+    if (blockEnd < r.x1) {
+        written += rasterizeScalar<TEST>(s, Rect{ blockEnd, r.y0, r.x1, r.y1 }, blockEnd, zbuffer, width, fragment);
+    }
+    return written;
+}
+
+// 8x1 pixel blocks, the last block of a row is masked instead of split off
+template <DepthTest TEST, class Fragment>
+MYRENDERER_TARGET("avx2")
+int rasterizeAVX2(const TriangleSetup& s, const Rect& r, float *zbuffer, int width, const Fragment& fragment) {
+    auto written = 0;
+    auto tested = 0;
+    const auto ilanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i lanes[3], step[3];
+    for (int k = 0; k < 3; ++k) {
+        lanes[k] = _mm256_mullo_epi32(ilanes, _mm256_set1_epi32(s.ex[k]));
+        step[k] = _mm256_set1_epi32(8 * s.ex[k]);
+    }
+    const auto zdx = _mm256_set1_ps(s.z.dx);
+    for (int y = r.y0; y < r.y1; ++y) {
+        const auto dy = y - s.bbox.y0;
+        __m256i e[3];
+        for (int k = 0; k < 3; ++k) {
+            const auto start = s.e0[k] + s.ey[k] * std::int64_t{ dy } + s.ex[k] * std::int64_t{ r.x0 - s.bbox.x0 };
+            e[k] = _mm256_add_epi32(_mm256_set1_epi32(static_cast<std::int32_t>(start)), lanes[k]);
+        }
+        const auto zRow = _mm256_set1_ps(s.z.row(dy));
+        auto dx = _mm256_cvtepi32_ps(_mm256_add_epi32(ilanes, _mm256_set1_epi32(r.x0 - s.bbox.x0)));
+        for (int x = r.x0; x < r.x1; x += 8) {
+            const auto inRow = _mm256_cmpgt_epi32(_mm256_set1_epi32(r.x1 - x), ilanes);
+            const auto outside = _mm256_or_si256(_mm256_or_si256(e[0], e[1]), e[2]);
+            const auto inside = _mm256_castsi256_ps(_mm256_and_si256(inRow, _mm256_cmpgt_epi32(outside, _mm256_set1_epi32(-1))));
+            if (const auto covered = _mm256_movemask_ps(inside)) {
+                tested += bitCount(covered);
+                auto *depth = zbuffer + x + y * width;
+                const auto z = _mm256_add_ps(zRow, _mm256_mul_ps(zdx, dx));
+                const auto old = _mm256_maskload_ps(depth, inRow);
+                const auto nearer = TEST == DepthTest::Greater ? _mm256_cmp_ps(old, z, _CMP_LT_OQ) : _mm256_cmp_ps(old, z, _CMP_LE_OQ);
+                const auto pass = _mm256_and_ps(inside, nearer);
+                if (const auto bits = _mm256_movemask_ps(pass)) {
+                    _mm256_maskstore_ps(depth, _mm256_castps_si256(pass), z);
+                    written += emitFragments(fragment, x, y, bits);
+                }
+            }
+            for (int k = 0; k < 3; ++k) {
+                e[k] = _mm256_add_epi32(e[k], step[k]);
+            }
+            dx = _mm256_add_ps(dx, _mm256_set1_ps(8));
+        }
+    }
+    profile::count(profile::Counter::FragmentsTested, tested);
+    return written;
+}
+#endif
+
+// Draws the pixels of s inside clip with the widest kernel the CPU allows,
+// returns the number of pixels that passed the depth test
+template <DepthTest TEST = DepthTest::Greater, class Fragment>
+int rasterizeWith(const TriangleSetup& s, const Rect& clip, float *zbuffer, int width, const Fragment& fragment) {
+    const Rect r{ std::max(s.bbox.x0, clip.x0), std::max(s.bbox.y0, clip.y0),
+                  std::min(s.bbox.x1, clip.x1), std::min(s.bbox.y1, clip.y1) };
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return 0;
+#ifdef MYRENDERER_X86
+    if (s.narrow) {
+        switch (simdLevel()) {
+            case SimdLevel::AVX2: return rasterizeAVX2<TEST>(s, r, zbuffer, width, fragment);
+            case SimdLevel::SSE2: return rasterizeSSE2<TEST>(s, r, zbuffer, width, fragment);
+            default: break;
+        }
+    }
+#endif
+    return rasterizeScalar<TEST>(s, r, r.x0, zbuffer, width, fragment);
+}
+
+#endif //MYRENDERER_RASTERLOOP_H
@@ -0,0 +1,208 @@
+#ifndef MYRENDERER_SHADERPIPELINE_H
+#define MYRENDERER_SHADERPIPELINE_H
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "clipper.h"
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "primitiveassembly.h"
+#include "rasterloop.h"
+#include "tilerenderer.h"
+#include "vertexstage.h"
+
+// Values a vertex shader hands to the fragment shader, interpolated perspective-correctly
+template <int N>
+using Varyings = std::array<float, N>;
+
+// Draws faces through a user shader, a class with
+//
+//   static constexpr int VARYINGS;
+//   // Clip-space position of a face corner, screen pixels after the divide
+//   // by w, and the values to interpolate across the face
+//   Vec4f vertex(int face, int corner, Varyings<VARYINGS>& out) const;
+//   // Color of a pixel that passed the depth test
+//   TGAColor fragment(const Varyings<VARYINGS>& in) const;
+//
+// The pipeline is instantiated per shader class: both functions are called
+// directly and inlined into the rasterizer kernels, there is no virtual call
+// per vertex or fragment. Triangles are culled and clipped like
+// PrimitiveAssembly does, by the same clipper with the varyings as payload,
+// and go through the tile renderer and its depth tests.
+template <class Shader>
+class ShaderPipeline {
+public:
+    static constexpr int N = Shader::VARYINGS;
+    using Vary = Varyings<N>;
+
+    ShaderPipeline(TileRenderer& renderer, const Rect& viewport, bool cullBackFaces = true)
+        : mRenderer(renderer), mViewport(viewport), mCullBackFaces(cullBackFaces) {}
+
+    // Shades the corners of faces [first, first + count) and queues what is visible
+    void submit(const Shader& shader, int first, int count);
+    // Depth of the triangles queued since the last prepass only, they stay
+    // queued. Once everything is queued and prepassed, render() shades just
+    // the fragments left nearest, one per pixel unless triangles tie in depth.
+    void prepass(DepthBuffer& depth);
+    // Rasterizes the queued triangles and drops them, returns the shaded pixels
+    long render(const Shader& shader, Framebuffer& frame, DepthBuffer& depth);
+
+    [[nodiscard]] const PrimitiveAssembly::Stats& stats() const { return mStats; }
+
+private:
+    using Corner = ClipVertex<N>;
+
+    void clip(const Corner *corners, std::uint8_t planes);
+    void emit(const Corner& a, const Corner& b, const Corner& c, const std::array<Vec3f, 3>& pts);
+
+    TileRenderer& mRenderer;
+    Rect mViewport;
+    bool mCullBackFaces;
+    int mPrepassed = 0; // queued triangles whose depth is already in the buffer
+    // N + 1 planes per submitted triangle: 1/w, then every varying divided by w
+    std::vector<Plane> mPlanes;
+    PrimitiveAssembly::Stats mStats;
+};
+
+namespace shading {
+
+// Plane through the values a at the corners pts, in the pixel units of s:
+// counted from the center of its first bbox pixel, over the snapped positions
+inline Plane attributePlane(const TriangleSetup& s, const std::array<Vec3f, 3>& pts, float a0, float a1, float a2) {
+    double x[3], y[3];
+    for (int i = 0; i < 3; ++i) {
+        x[i] = static_cast<double>(std::lround(pts[i].x * SUBPIXEL_ONE)) / SUBPIXEL_ONE;
+        y[i] = static_cast<double>(std::lround(pts[i].y * SUBPIXEL_ONE)) / SUBPIXEL_ONE;
+    }
+    const auto area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    const auto d1 = static_cast<double>(a1) - a0;
+    const auto d2 = static_cast<double>(a2) - a0;
+    const auto dx = (d1 * (y[2] - y[0]) - d2 * (y[1] - y[0])) / area;
+    const auto dy = (d2 * (x[1] - x[0]) - d1 * (x[2] - x[0])) / area;
+    const auto c = a0 + dx * (s.bbox.x0 + .5 - x[0]) + dy * (s.bbox.y0 + .5 - y[0]);
+    return Plane{ static_cast<float>(c), static_cast<float>(dx), static_cast<float>(dy) };
+}
+
+template <class Shader>
+struct ShaderFragment {
+    const TriangleSetup& s;
+    const Plane *planes;
+    const Shader& shader;
+    Framebuffer& frame;
+
+    void operator()(int x, int y) const {
+        const auto dx = static_cast<float>(x - s.bbox.x0);
+        const auto dy = y - s.bbox.y0;
+        const auto w = 1.f / (planes[0].row(dy) + planes[0].dx * dx);
+        Varyings<Shader::VARYINGS> in;
+        for (int i = 0; i < Shader::VARYINGS; ++i) {
+            in[i] = (planes[i + 1].row(dy) + planes[i + 1].dx * dx) * w;
+        }
+        frame.set(x, y, Framebuffer::pack(shader.fragment(in)) | Framebuffer::OPAQUE);
+    }
+};
+
+}
+
+template <class Shader>
+void ShaderPipeline<Shader>::submit(const Shader& shader, int first, int count) {
+    for (int face = first; face < first + count; ++face) {
+        ++mStats.triangles;
+        Corner corners[3];
+        std::uint8_t codes[3];
+        for (int i = 0; i < 3; ++i) {
+            corners[i].p = shader.vertex(face, i, corners[i].v);
+            codes[i] = computeClipCode(corners[i].p.x, corners[i].p.y, corners[i].p.w, mViewport);
+        }
+        if (codes[0] & codes[1] & codes[2] & CLIP_FRUSTUM) {
+            ++mStats.outside;
+            continue;
+        }
+        const auto planes = static_cast<std::uint8_t>((codes[0] | codes[1] | codes[2]) & CLIP_NEEDED);
+        if (planes) {
+            clip(corners, planes);
+            continue;
+        }
+        const std::array<Vec3f, 3> pts{ corners[0].p.project(), corners[1].p.project(), corners[2].p.project() };
+        if (mCullBackFaces && signedArea(pts[0], pts[1], pts[2]) <= 0) {
+            ++mStats.backFacing;
+            continue;
+        }
+        emit(corners[0], corners[1], corners[2], pts);
+    }
+}
+
+template <class Shader>
+void ShaderPipeline<Shader>::clip(const Corner *corners, std::uint8_t planes) {
+    Corner v[MAX_CLIP_VERTS];
+    const auto n = clipTriangle(corners, planes, v);
+    if (n < 3) {
+        ++mStats.outside;
+        return;
+    }
+
+    Vec3f screen[MAX_CLIP_VERTS];
+    const auto area = projectPolygon(v, n, screen);
+    if (mCullBackFaces && area <= 0) {
+        ++mStats.backFacing;
+        return;
+    }
+    ++mStats.clipped;
+    for (int i = 1; i + 1 < n; ++i) {
+        emit(v[0], v[i], v[i + 1], { screen[0], screen[i], screen[i + 1] });
+    }
+}
+
+template <class Shader>
+void ShaderPipeline<Shader>::emit(const Corner& a, const Corner& b, const Corner& c, const std::array<Vec3f, 3>& pts) {
+    const auto id = static_cast<std::uint32_t>(mPlanes.size() / (N + 1));
+    if (!mRenderer.submit(pts, { 0.f, 0.f, 0.f }, id)) return;
+    ++mStats.submitted;
+    const auto& s = mRenderer.triangle(mRenderer.ntriangles() - 1);
+    const auto qa = 1.f / a.p.w;
+    const auto qb = 1.f / b.p.w;
+    const auto qc = 1.f / c.p.w;
+    mPlanes.push_back(shading::attributePlane(s, pts, qa, qb, qc));
+    for (int k = 0; k < N; ++k) {
+        mPlanes.push_back(shading::attributePlane(s, pts, a.v[k] * qa, b.v[k] * qb, c.v[k] * qc));
+    }
+}
+
+template <class Shader>
+void ShaderPipeline<Shader>::prepass(DepthBuffer& depth) {
+    mRenderer.renderDepth(depth, mPrepassed);
+    mPrepassed = mRenderer.ntriangles();
+}
+
+template <class Shader>
+long ShaderPipeline<Shader>::render(const Shader& shader, Framebuffer& frame, DepthBuffer& depth) {
+    const auto before = mRenderer.stats().fragments;
+    const auto draw = [&](auto test) {
+        mRenderer.renderWith(depth, [&](int idx, const Rect& clip) {
+            const auto& s = mRenderer.triangle(idx);
+            const auto *planes = mPlanes.data() + static_cast<std::size_t>(mRenderer.id(idx)) * (N + 1);
+            return rasterizeWith<decltype(test)::value>(s, clip, depth.data(), frame.width(),
+                                                        shading::ShaderFragment<Shader>{ s, planes, shader, frame });
+        });
+    };
+    // After a prepass the depth buffer already holds the nearest depth, the
+    // very same triangles reproduce it exactly
+    if (mPrepassed > 0) {
+        assert(mPrepassed == mRenderer.ntriangles());
+        draw(std::integral_constant<DepthTest, DepthTest::GreaterEqual>{});
+    } else {
+        draw(std::integral_constant<DepthTest, DepthTest::Greater>{});
+    }
+    mPrepassed = 0;
+    mRenderer.clear();
+    mPlanes.clear();
+    return mRenderer.stats().fragments - before;
+}
+
+#endif //MYRENDERER_SHADERPIPELINE_H
@@ -0,0 +1,126 @@
+#ifndef MYRENDERER_SHADERS_H
+#define MYRENDERER_SHADERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "geometry.h"
+#include "model.h"
+#include "shaderpipeline.h"
+#include "../dependencies/tgaimage.h"
+
+// Shaders for ShaderPipeline. transform maps model space to clip space,
+// lightDir points towards the light in model space.
+
+enum class ShaderKind { Gouraud, Textured, Phong };
+
+// Accepts "gouraud", "textured" and "phong"
+inline bool parseShaderKind(const std::string& name, ShaderKind& kind) {
+    if (name == "gouraud") kind = ShaderKind::Gouraud;
+    else if (name == "textured") kind = ShaderKind::Textured;
+    else if (name == "phong") kind = ShaderKind::Phong;
+    else return false;
+    return true;
+}
+
+// White, lit per corner and interpolated, what the fixed forward path draws
+class GouraudShader {
+public:
+    static constexpr int VARYINGS = 1;
+
+    GouraudShader(const Model& model, const Mat4f& transform, const Vec3f& lightDir)
+        : mModel(model), mTransform(transform), mLightDir(lightDir) {}
+
+    Vec4f vertex(int face, int corner, Varyings<VARYINGS>& out) const {
+        out[0] = mModel.getNorm(face, corner) * mLightDir;
+        return mTransform * Vec4f{ mModel.getVert(mModel.getFace(face)[corner]), 1.f };
+    }
+
+    TGAColor fragment(const Varyings<VARYINGS>& in) const {
+        return TGAColor{ 255, 255, 255 } * in[0];
+    }
+
+private:
+    const Model& mModel;
+    Mat4f mTransform;
+    Vec3f mLightDir;
+};
+
+// Diffuse texture, nearest texel, times the Gouraud intensity
+class TexturedShader {
+public:
+    static constexpr int VARYINGS = 3; // u, v in texels, intensity
+
+    TexturedShader(const Model& model, const Mat4f& transform, const Vec3f& lightDir)
+        : mModel(model), mTransform(transform), mLightDir(lightDir) {}
+
+    Vec4f vertex(int face, int corner, Varyings<VARYINGS>& out) const {
+        const auto uv = mModel.getUvf(face, corner);
+        out[0] = uv.x;
+        out[1] = uv.y;
+        out[2] = mModel.getNorm(face, corner) * mLightDir;
+        return mTransform * Vec4f{ mModel.getVert(mModel.getFace(face)[corner]), 1.f };
+    }
+
+    TGAColor fragment(const Varyings<VARYINGS>& in) const {
+        return mModel.getDiffuseColor(Vec2i{ static_cast<int>(in[0]), static_cast<int>(in[1]) }) * in[2];
+    }
+
+private:
+    const Model& mModel;
+    Mat4f mTransform;
+    Vec3f mLightDir;
+};
+
+// Diffuse texture lit per pixel from the interpolated normal, with a
+// Blinn-Phong highlight for a viewer looking along viewDir
+class PhongShader {
+public:
+    static constexpr int VARYINGS = 5; // u, v in texels, normal
+
+    PhongShader(const Model& model, const Mat4f& transform, const Vec3f& lightDir, Vec3f viewDir)
+        : mModel(model), mTransform(transform), mLightDir(lightDir), mHalf(unit(lightDir + unit(viewDir))) {}
+
+    Vec4f vertex(int face, int corner, Varyings<VARYINGS>& out) const {
+        const auto uv = mModel.getUvf(face, corner);
+        const auto n = mModel.getNorm(face, corner);
+        out[0] = uv.x;
+        out[1] = uv.y;
+        out[2] = n.x;
+        out[3] = n.y;
+        out[4] = n.z;
+        return mTransform * Vec4f{ mModel.getVert(mModel.getFace(face)[corner]), 1.f };
+    }
+
+    TGAColor fragment(const Varyings<VARYINGS>& in) const {
+        const auto n = unit(Vec3f{ in[2], in[3], in[4] });
+        const auto diffuse = n * mLightDir;
+        auto color = mModel.getDiffuseColor(Vec2i{ static_cast<int>(in[0]), static_cast<int>(in[1]) }) * diffuse;
+        if (diffuse > 0) {
+            const auto highlight = SPECULAR * std::pow(std::max(0.f, n * mHalf), SHININESS);
+            for (int i = 0; i < 3; ++i) {
+                color.bgra[i] = static_cast<std::uint8_t>(std::min(255.f, color.bgra[i] + highlight));
+            }
+        }
+        return color;
+    }
+
+private:
+    static constexpr float SPECULAR = 96.f;  // highlight peak added to every channel
+    static constexpr float SHININESS = 24.f;
+
+    // With a real sqrt, the highlight is sensitive to the normal's length. A
+    // vector too short to have a direction stays zero, which lights nothing.
+    static Vec3f unit(const Vec3f& v) {
+        const auto length = v.norm();
+        return length > 1e-6f ? v * (1.f / length) : Vec3f{ 0, 0, 0 };
+    }
+
+    const Model& mModel;
+    Mat4f mTransform;
+    Vec3f mLightDir;
+    Vec3f mHalf;
+};
+
+#endif //MYRENDERER_SHADERS_H
@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cmath>
+
+#include "camerapath.h"
+#include "profiler.h"
+#include "shadowmap.h"
+
+ShadowMap::ShadowMap(int size, ThreadPool& pool)
+    : mSize(size), mDepth(size, size), mRenderer(size, size, pool), mVertices(pool),
+      // Whatever faces the light or not, the nearest surface is what casts the shadow
+      mAssembly(mVertices, mRenderer, false) {
+}
+
+void ShadowMap::render(const Model& model, const Vec3f& lightDir) {
+    PROFILE_SCOPE("shadow map");
+    mDepth.clear();
+    mAssembly.clear();
+    mRenderer.resetStats();
+    mRasterized = 0;
+    const auto bvh = model.bvh();
+    if (bvh.empty()) return;
+
+    // The sphere around the root box fits into the map from any direction
+    const auto& root = bvh[0];
+    const auto mid = (root.lo + root.hi) * .5f;
+    const auto radius = std::max((root.hi - root.lo).norm() * .5f, 1e-6f);
+    auto toOrigin = Mat4f::identity();
+    auto scale = Mat4f::identity();
+    for (int i = 0; i < 3; ++i) {
+        toOrigin[i][3] = -mid[i];
+        scale[i][i] = 1.f / radius;
+    }
+    const auto up = std::abs(lightDir.y) > .99f ? Vec3f{ 0, 0, 1 } : Vec3f{ 0, 1, 0 };
+    mTransform = viewport(0, 0, mSize, mSize) * scale * lookAt(lightDir, Vec3f{ 0, 0, 0 }, up) * toOrigin;
+
+    mVertices.run(model, mTransform, Rect{ 0, 0, mSize, mSize });
+    for (int i = 0; i < model.nfaces(); ++i) {
+        const auto face = model.getFace(i);
+        mAssembly.submit(i, { face[0], face[1], face[2] }, { 0.f, 0.f, 0.f });
+    }
+    mRasterized = mRenderer.ntriangles();
+    mRenderer.renderDepth(mDepth);
+    mRenderer.clear();
+}
+
+float ShadowMap::lit(const Vec3f& p, int pcf) const {
+    const auto cx = static_cast<int>(std::floor(p.x));
+    const auto cy = static_cast<int>(std::floor(p.y));
+    const auto *depth = mDepth.data();
+    auto lit = 0;
+    auto taps = 0;
+    for (int y = cy - pcf; y <= cy + pcf; ++y) {
+        for (int x = cx - pcf; x <= cx + pcf; ++x) {
+            ++taps;
+            // Nothing outside the map casts a shadow
+            if (x < 0 || y < 0 || x >= mSize || y >= mSize || depth[x + y * mSize] <= p.z + mBias) ++lit;
+        }
+    }
+    return static_cast<float>(lit) / static_cast<float>(taps);
+}
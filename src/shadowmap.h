@@ -0,0 +1,50 @@
+#ifndef MYRENDERER_SHADOWMAP_H
+#define MYRENDERER_SHADOWMAP_H
+
+#include "depthbuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "primitiveassembly.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+#include "vertexstage.h"
+
+// Depth of a model as seen by a directional light, drawn with the depth-only
+// rasterizer through an orthographic view of its own that fits the model
+// into a size x size map. Depth grows towards the light like on screen.
+class ShadowMap {
+public:
+    ShadowMap(int size, ThreadPool& pool);
+    ShadowMap(const ShadowMap&) = delete;
+    ShadowMap& operator=(const ShadowMap&) = delete;
+
+    // Light shining from lightDir, the direction lit normals point to. The
+    // map only has to be redrawn when the model or the light changes.
+    void render(const Model& model, const Vec3f& lightDir);
+
+    // 1 for a point the light reaches, 0 in shadow. p is in map space, see
+    // transform(). pcf > 0 averages the (2 pcf + 1)^2 nearest texels instead of one.
+    [[nodiscard]] float lit(const Vec3f& p, int pcf) const;
+
+    [[nodiscard]] int size() const { return mSize; }
+    // Model space to map texels and depth
+    [[nodiscard]] const Mat4f& transform() const { return mTransform; }
+    [[nodiscard]] const DepthBuffer& depth() const { return mDepth; }
+    // Depth a point may lie behind the map and still count as lit, against self-shadowing.
+    // The map spans 255 depth units over the diameter of the model.
+    [[nodiscard]] float bias() const { return mBias; }
+    void setBias(float bias) { mBias = bias; }
+    [[nodiscard]] int rasterized() const { return mRasterized; }
+
+private:
+    int mSize;
+    float mBias = 2.f;
+    Mat4f mTransform = Mat4f::identity();
+    DepthBuffer mDepth;
+    TileRenderer mRenderer;
+    VertexStage mVertices;
+    PrimitiveAssembly mAssembly;
+    int mRasterized = 0;
+};
+
+#endif //MYRENDERER_SHADOWMAP_H
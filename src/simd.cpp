@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "simd.h"
+
+SimdLevel detectSimd() {
+    static const auto level = [] {
+#if defined(MYRENDERER_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#elif defined(MYRENDERER_X86) && defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] >= 7) {
+            int ext[4];
+            __cpuidex(ext, 7, 0);
+            __cpuid(regs, 1);
+            const auto osxsave = (regs[2] & (1 << 27)) != 0;
+            if (osxsave && (ext[1] & (1 << 5)) && (_xgetbv(0) & 6) == 6) return SimdLevel::AVX2;
+        }
+        __cpuid(regs, 1);
+        if (regs[3] & (1 << 26)) return SimdLevel::SSE2;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+static std::atomic<SimdLevel> currentLevel{ detectSimd() };
+
+SimdLevel simdLevel() {
+    return currentLevel.load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(SimdLevel level) {
+    currentLevel = std::min(level, detectSimd());
+}
+
+const char *simdName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE2: return "sse2";
+        default:              return "scalar";
+    }
+}
+
+#ifdef MYRENDERER_X86
+MYRENDERER_TARGET("avx2")
+static std::size_t fillAVX2(std::uint8_t *dst, std::size_t count, std::uint32_t value) {
+    const auto v = _mm256_set1_epi32(static_cast<int>(value));
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 8) * 4), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 16) * 4), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i + 24) * 4), v);
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), v);
+    }
+    return i;
+}
+
+MYRENDERER_TARGET("sse2")
+static std::size_t fillSSE2(std::uint8_t *dst, std::size_t count, std::uint32_t value) {
+    const auto v = _mm_set1_epi32(static_cast<int>(value));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i + 4) * 4), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i + 8) * 4), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i + 12) * 4), v);
+    }
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), v);
+    }
+    return i;
+}
+#endif
+
+void fill32(void *dst, std::size_t count, std::uint32_t value) {
+    auto *bytes = static_cast<std::uint8_t *>(dst);
+    if (value == (value & 0xff) * 0x01010101u) {
+        std::memset(bytes, static_cast<int>(value & 0xff), count * sizeof(value));
+        return;
+    }
+    std::size_t i = 0;
+#ifdef MYRENDERER_X86
+    switch (simdLevel()) {
+        case SimdLevel::AVX2: i = fillAVX2(bytes, count, value); break;
+        case SimdLevel::SSE2: i = fillSSE2(bytes, count, value); break;
+        default: break;
+    }
+#endif
+    for (; i < count; ++i) {
+        std::memcpy(bytes + i * sizeof(value), &value, sizeof(value));
+    }
+}
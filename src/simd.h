@@ -0,0 +1,48 @@
+#ifndef MYRENDERER_SIMD_H
+#define MYRENDERER_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MYRENDERER_X86 1
+#include <immintrin.h>
+// Lets a single function use instructions above the compiler baseline,
+// callers must check simdLevel() before calling it
+#define MYRENDERER_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MYRENDERER_X86 1
+#include <immintrin.h>
+#define MYRENDERER_TARGET(isa)
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+inline int lowestBit(unsigned mask) { unsigned long idx; _BitScanForward(&idx, mask); return static_cast<int>(idx); }
+inline int lowestBit64(std::uint64_t mask) { unsigned long idx; _BitScanForward64(&idx, mask); return static_cast<int>(idx); }
+// Without relying on the POPCNT instruction, masks here have at most 8 bits
+inline int bitCount(unsigned mask) { auto n = 0; for (; mask; mask &= mask - 1) ++n; return n; }
+#else
+inline int lowestBit(unsigned mask) { return __builtin_ctz(mask); }
+inline int lowestBit64(std::uint64_t mask) { return __builtin_ctzll(mask); }
+inline int bitCount(unsigned mask) { return __builtin_popcount(mask); }
+#endif
+
+enum class SimdLevel { Scalar = 0, SSE2 = 1, AVX2 = 2 };
+
+// Best instruction set supported by this CPU, detected once
+[[nodiscard]] SimdLevel detectSimd();
+
+// Instruction set the SIMD kernels use, defaults to detectSimd().
+// setSimdLevel can only go down from what the CPU supports.
+[[nodiscard]] SimdLevel simdLevel();
+void setSimdLevel(SimdLevel level);
+
+[[nodiscard]] const char *simdName(SimdLevel level);
+
+// Sets count 32-bit words at dst to the bits of value, which makes it usable
+// for float buffers too: memset when the four bytes are equal, otherwise
+// vector stores of the widest allowed level
+void fill32(void *dst, std::size_t count, std::uint32_t value);
+
+#endif //MYRENDERER_SIMD_H
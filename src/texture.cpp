@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "simd.h"
+#include "texture.h"
+
+namespace {
+
+// Texel (x, y) of a level: 4x4 blocks row by row, Z-order inside a block
+inline std::size_t texelIndex(int x, int y, int tilesX) {
+    const auto block = static_cast<std::size_t>((y >> 2) * tilesX + (x >> 2));
+    return block * 16 + ((x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2));
+}
+
+inline int clampInt(int v, int lo, int hi) {
+    return std::min(std::max(v, lo), hi);
+}
+
+inline float channel(std::uint32_t texel, int k) {
+    return static_cast<float>((texel >> (8 * k)) & 0xff);
+}
+
+inline std::uint32_t pack(const float c[4]) {
+    auto res = 0u;
+    for (int k = 0; k < 4; ++k) {
+        res |= static_cast<std::uint32_t>(c[k] + .5f) << (8 * k);
+    }
+    return res;
+}
+
+// The SIMD versions below do exactly these operations in this order
+void bilinear(const std::uint32_t *texels, const Texture::Level& l, float u, float v, float out[4]) {
+    const auto x = std::min(std::max(u * l.scaleX - .5f, -1.f), static_cast<float>(l.width));
+    const auto y = std::min(std::max(v * l.scaleY - .5f, -1.f), static_cast<float>(l.height));
+    const auto fx0 = std::floor(x);
+    const auto fy0 = std::floor(y);
+    const auto fx = x - fx0;
+    const auto fy = y - fy0;
+    const auto x0 = clampInt(static_cast<int>(fx0), 0, l.width - 1);
+    const auto x1 = clampInt(static_cast<int>(fx0) + 1, 0, l.width - 1);
+    const auto y0 = clampInt(static_cast<int>(fy0), 0, l.height - 1);
+    const auto y1 = clampInt(static_cast<int>(fy0) + 1, 0, l.height - 1);
+    const auto *base = texels + l.offset;
+    const auto t00 = base[texelIndex(x0, y0, l.tilesX)];
+    const auto t10 = base[texelIndex(x1, y0, l.tilesX)];
+    const auto t01 = base[texelIndex(x0, y1, l.tilesX)];
+    const auto t11 = base[texelIndex(x1, y1, l.tilesX)];
+    for (int k = 0; k < 4; ++k) {
+        const auto top = channel(t00, k) + (channel(t10, k) - channel(t00, k)) * fx;
+        const auto bottom = channel(t01, k) + (channel(t11, k) - channel(t01, k)) * fx;
+        out[k] = top + (bottom - top) * fy;
+    }
+}
+
+#ifdef MYRENDERER_X86
+// Bilinear taps for 4 lanes, addresses are computed and loaded lane by lane
+MYRENDERER_TARGET("sse2")
+void bilinearSSE2(const std::uint32_t *texels, const Texture::Level& l, const float *u, const float *v, __m128 out[4]) {
+    auto x = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(u), _mm_set1_ps(l.scaleX)), _mm_set1_ps(.5f));
+    auto y = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(v), _mm_set1_ps(l.scaleY)), _mm_set1_ps(.5f));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.f)), _mm_set1_ps(static_cast<float>(l.width)));
+    y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(-1.f)), _mm_set1_ps(static_cast<float>(l.height)));
+    // floor without SSE4.1, truncation rounds up below zero
+    const auto one = _mm_set1_ps(1.f);
+    auto fx0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    auto fy0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+    fx0 = _mm_sub_ps(fx0, _mm_and_ps(_mm_cmpgt_ps(fx0, x), one));
+    fy0 = _mm_sub_ps(fy0, _mm_and_ps(_mm_cmpgt_ps(fy0, y), one));
+    const auto fx = _mm_sub_ps(x, fx0);
+    const auto fy = _mm_sub_ps(y, fy0);
+
+    alignas(16) std::int32_t ix[4], iy[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(ix), _mm_cvttps_epi32(fx0));
+    _mm_store_si128(reinterpret_cast<__m128i *>(iy), _mm_cvttps_epi32(fy0));
+    alignas(16) std::uint32_t t[4][4];
+    const auto *base = texels + l.offset;
+    for (int i = 0; i < 4; ++i) {
+        const auto x0 = clampInt(ix[i], 0, l.width - 1);
+        const auto x1 = clampInt(ix[i] + 1, 0, l.width - 1);
+        const auto y0 = clampInt(iy[i], 0, l.height - 1);
+        const auto y1 = clampInt(iy[i] + 1, 0, l.height - 1);
+        t[0][i] = base[texelIndex(x0, y0, l.tilesX)];
+        t[1][i] = base[texelIndex(x1, y0, l.tilesX)];
+        t[2][i] = base[texelIndex(x0, y1, l.tilesX)];
+        t[3][i] = base[texelIndex(x1, y1, l.tilesX)];
+    }
+    __m128i taps[4];
+    for (int j = 0; j < 4; ++j) {
+        taps[j] = _mm_load_si128(reinterpret_cast<const __m128i *>(t[j]));
+    }
+    const auto mask = _mm_set1_epi32(0xff);
+    for (int k = 0; k < 4; ++k) {
+        const auto c00 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(taps[0], 8 * k), mask));
+        const auto c10 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(taps[1], 8 * k), mask));
+        const auto c01 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(taps[2], 8 * k), mask));
+        const auto c11 = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(taps[3], 8 * k), mask));
+        const auto top = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), fx));
+        const auto bottom = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), fx));
+        out[k] = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+    }
+}
+
+MYRENDERER_TARGET("sse2")
+void packSSE2(const __m128 c[4], std::uint32_t *out) {
+    auto res = _mm_setzero_si128();
+    for (int k = 0; k < 4; ++k) {
+        res = _mm_or_si128(res, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(c[k], _mm_set1_ps(.5f))), 8 * k));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), res);
+}
+
+MYRENDERER_TARGET("sse2")
+void sampleSSE2(const std::uint32_t *texels, const Texture::Level *l0, const Texture::Level *l1, float blend,
+                const float *u, const float *v, std::uint32_t *out) {
+    __m128 a[4];
+    bilinearSSE2(texels, *l0, u, v, a);
+    if (l1) {
+        __m128 b[4];
+        bilinearSSE2(texels, *l1, u, v, b);
+        const auto t = _mm_set1_ps(blend);
+        for (int k = 0; k < 4; ++k) {
+            a[k] = _mm_add_ps(a[k], _mm_mul_ps(_mm_sub_ps(b[k], a[k]), t));
+        }
+    }
+    packSSE2(a, out);
+}
+
+// texelIndex() for 8 lanes
+MYRENDERER_TARGET("avx2")
+inline __m256i blockIndex(__m256i x, __m256i y, __m256i tilesX) {
+    const auto one = _mm256_set1_epi32(1);
+    const auto two = _mm256_set1_epi32(2);
+    const auto block = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 2), tilesX), _mm256_srli_epi32(x, 2));
+    const auto z = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x, one), _mm256_slli_epi32(_mm256_and_si256(y, one), 1)),
+                                   _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, two), 1), _mm256_slli_epi32(_mm256_and_si256(y, two), 2)));
+    return _mm256_add_epi32(_mm256_slli_epi32(block, 4), z);
+}
+
+// Bilinear taps for 8 lanes with the block addresses computed in vector registers
+MYRENDERER_TARGET("avx2")
+void bilinearAVX2(const std::uint32_t *texels, const Texture::Level& l, const float *u, const float *v, __m256 out[4]) {
+    auto x = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(u), _mm256_set1_ps(l.scaleX)), _mm256_set1_ps(.5f));
+    auto y = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(v), _mm256_set1_ps(l.scaleY)), _mm256_set1_ps(.5f));
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-1.f)), _mm256_set1_ps(static_cast<float>(l.width)));
+    y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(-1.f)), _mm256_set1_ps(static_cast<float>(l.height)));
+    const auto fx0 = _mm256_floor_ps(x);
+    const auto fy0 = _mm256_floor_ps(y);
+    const auto fx = _mm256_sub_ps(x, fx0);
+    const auto fy = _mm256_sub_ps(y, fy0);
+
+    const auto zero = _mm256_setzero_si256();
+    const auto one = _mm256_set1_epi32(1);
+    const auto maxX = _mm256_set1_epi32(l.width - 1);
+    const auto maxY = _mm256_set1_epi32(l.height - 1);
+    const auto ix = _mm256_cvttps_epi32(fx0);
+    const auto iy = _mm256_cvttps_epi32(fy0);
+    const auto x0 = _mm256_min_epi32(_mm256_max_epi32(ix, zero), maxX);
+    const auto x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(ix, one), zero), maxX);
+    const auto y0 = _mm256_min_epi32(_mm256_max_epi32(iy, zero), maxY);
+    const auto y1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iy, one), zero), maxY);
+
+    const auto tilesX = _mm256_set1_epi32(l.tilesX);
+    const auto *base = reinterpret_cast<const int *>(texels + l.offset);
+    const __m256i taps[4] = { _mm256_i32gather_epi32(base, blockIndex(x0, y0, tilesX), 4), _mm256_i32gather_epi32(base, blockIndex(x1, y0, tilesX), 4),
+                              _mm256_i32gather_epi32(base, blockIndex(x0, y1, tilesX), 4), _mm256_i32gather_epi32(base, blockIndex(x1, y1, tilesX), 4) };
+    const auto mask = _mm256_set1_epi32(0xff);
+    for (int k = 0; k < 4; ++k) {
+        const auto c00 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(taps[0], 8 * k), mask));
+        const auto c10 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(taps[1], 8 * k), mask));
+        const auto c01 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(taps[2], 8 * k), mask));
+        const auto c11 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(taps[3], 8 * k), mask));
+        const auto top = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c10, c00), fx));
+        const auto bottom = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_sub_ps(c11, c01), fx));
+        out[k] = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy));
+    }
+}
+
+MYRENDERER_TARGET("avx2")
+void sampleAVX2(const std::uint32_t *texels, const Texture::Level *l0, const Texture::Level *l1, float blend,
+                const float *u, const float *v, std::uint32_t *out) {
+    __m256 a[4];
+    bilinearAVX2(texels, *l0, u, v, a);
+    if (l1) {
+        __m256 b[4];
+        bilinearAVX2(texels, *l1, u, v, b);
+        const auto t = _mm256_set1_ps(blend);
+        for (int k = 0; k < 4; ++k) {
+            a[k] = _mm256_add_ps(a[k], _mm256_mul_ps(_mm256_sub_ps(b[k], a[k]), t));
+        }
+    }
+    auto res = _mm256_setzero_si256();
+    for (int k = 0; k < 4; ++k) {
+        res = _mm256_or_si256(res, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_add_ps(a[k], _mm256_set1_ps(.5f))), 8 * k));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), res);
+}
+#endif
+
+}
+
+Texture::Texture(const std::uint8_t *pixels, int width, int height, int bpp, ThreadPool& pool) {
+    if (width <= 0 || height <= 0 || !(bpp == 1 || bpp == 3 || bpp == 4)) return;
+    setLevels(width, height);
+    mOwned.resize(storageSize(width, height));
+    mTexels = mOwned;
+
+    auto *texels = mOwned.data();
+    const auto& top = mLevels[0];
+    pool.parallelFor(height, [&](int y) {
+        for (int x = 0; x < width; ++x) {
+            const auto *p = pixels + (x + y * width) * bpp;
+            const std::uint32_t b = p[0];
+            const std::uint32_t g = bpp == 1 ? p[0] : p[1];
+            const std::uint32_t r = bpp == 1 ? p[0] : p[2];
+            const std::uint32_t a = bpp == 4 ? p[3] : 255;
+            texels[top.offset + texelIndex(x, y, top.tilesX)] = b | g << 8 | r << 16 | a << 24;
+        }
+    });
+
+    // Every mip texel is the rounded average of up to four texels of the level above
+    for (std::size_t i = 1; i < mLevels.size(); ++i) {
+        const auto& src = mLevels[i - 1];
+        const auto& dst = mLevels[i];
+        pool.parallelFor(dst.height, [&](int y) {
+            const auto y0 = 2 * y;
+            const auto y1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x) {
+                const auto x0 = 2 * x;
+                const auto x1 = std::min(2 * x + 1, src.width - 1);
+                const std::uint32_t t[4] = { texels[src.offset + texelIndex(x0, y0, src.tilesX)],
+                                             texels[src.offset + texelIndex(x1, y0, src.tilesX)],
+                                             texels[src.offset + texelIndex(x0, y1, src.tilesX)],
+                                             texels[src.offset + texelIndex(x1, y1, src.tilesX)] };
+                auto res = 0u;
+                for (int k = 0; k < 4; ++k) {
+                    auto sum = 2u;
+                    for (const auto texel: t) {
+                        sum += (texel >> (8 * k)) & 0xff;
+                    }
+                    res |= (sum / 4) << (8 * k);
+                }
+                texels[dst.offset + texelIndex(x, y, dst.tilesX)] = res;
+            }
+        });
+    }
+}
+
+Texture::Texture(ArrayView<std::uint32_t> texels, int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    assert(texels.size() == storageSize(width, height));
+    setLevels(width, height);
+    mTexels = texels;
+}
+
+void Texture::setLevels(int width, int height) {
+    mLevels.clear();
+    std::size_t offset = 0;
+    for (auto w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        const auto tilesX = (w + 3) / 4;
+        const auto tilesY = (h + 3) / 4;
+        mLevels.push_back(Level{ w, h, tilesX, offset,
+                                 static_cast<float>(w) / static_cast<float>(width),
+                                 static_cast<float>(h) / static_cast<float>(height) });
+        offset += static_cast<std::size_t>(tilesX) * tilesY * 16;
+        if (w == 1 && h == 1) break;
+    }
+}
+
+std::size_t Texture::storageSize(int width, int height) {
+    std::size_t size = 0;
+    for (auto w = width, h = height; w > 0 && h > 0; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        size += static_cast<std::size_t>((w + 3) / 4) * ((h + 3) / 4) * 16;
+        if (w == 1 && h == 1) break;
+    }
+    return size;
+}
+
+int Texture::levelOf(float lod, float& blend) const {
+    const auto last = static_cast<int>(mLevels.size()) - 1;
+    lod = std::min(std::max(lod, 0.f), static_cast<float>(last));
+    const auto level = std::min(static_cast<int>(lod), last);
+    blend = level < last ? lod - static_cast<float>(level) : 0.f;
+    return level;
+}
+
+std::uint32_t Texture::sampleNearest(float u, float v, int level) const {
+    if (empty()) return 0;
+    const auto& l = mLevels[clampInt(level, 0, levels() - 1)];
+    const auto x = static_cast<int>(std::min(std::max(u * l.scaleX, 0.f), static_cast<float>(l.width - 1)));
+    const auto y = static_cast<int>(std::min(std::max(v * l.scaleY, 0.f), static_cast<float>(l.height - 1)));
+    return mTexels[l.offset + texelIndex(x, y, l.tilesX)];
+}
+
+std::uint32_t Texture::sampleBilinear(float u, float v, int level) const {
+    if (empty()) return 0;
+    float c[4];
+    bilinear(mTexels.data(), mLevels[clampInt(level, 0, levels() - 1)], u, v, c);
+    return pack(c);
+}
+
+std::uint32_t Texture::sampleTrilinear(float u, float v, float lod) const {
+    if (empty()) return 0;
+    auto blend = 0.f;
+    const auto level = levelOf(lod, blend);
+    float a[4];
+    bilinear(mTexels.data(), mLevels[level], u, v, a);
+    if (blend > 0.f) {
+        float b[4];
+        bilinear(mTexels.data(), mLevels[level + 1], u, v, b);
+        for (int k = 0; k < 4; ++k) {
+            a[k] = a[k] + (b[k] - a[k]) * blend;
+        }
+    }
+    return pack(a);
+}
+
+std::uint32_t Texture::sample(float u, float v, float lod, TextureFilter filter) const {
+    switch (filter) {
+        case TextureFilter::Nearest: return sampleNearest(u, v, 0);
+        case TextureFilter::Bilinear: return sampleBilinear(u, v, 0);
+        default: return sampleTrilinear(u, v, lod);
+    }
+}
+
+void Texture::sample4(const float *u, const float *v, float lod, TextureFilter filter, std::uint32_t *out) const {
+#ifdef MYRENDERER_X86
+    if (!empty() && filter != TextureFilter::Nearest && simdLevel() >= SimdLevel::SSE2) {
+        auto blend = 0.f;
+        const auto level = filter == TextureFilter::Trilinear ? levelOf(lod, blend) : 0;
+        sampleSSE2(mTexels.data(), &mLevels[level], blend > 0.f ? &mLevels[level + 1] : nullptr, blend, u, v, out);
+        return;
+    }
+#endif
+    for (int i = 0; i < 4; ++i) {
+        out[i] = sample(u[i], v[i], lod, filter);
+    }
+}
+
+void Texture::sample8(const float *u, const float *v, float lod, TextureFilter filter, std::uint32_t *out) const {
+#ifdef MYRENDERER_X86
+    if (!empty() && filter != TextureFilter::Nearest && simdLevel() == SimdLevel::AVX2) {
+        auto blend = 0.f;
+        const auto level = filter == TextureFilter::Trilinear ? levelOf(lod, blend) : 0;
+        sampleAVX2(mTexels.data(), &mLevels[level], blend > 0.f ? &mLevels[level + 1] : nullptr, blend, u, v, out);
+        return;
+    }
+#endif
+    sample4(u, v, lod, filter, out);
+    sample4(u + 4, v + 4, lod, filter, out + 4);
+}
@@ -0,0 +1,76 @@
+#ifndef MYRENDERER_TEXTURE_H
+#define MYRENDERER_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arrayview.h"
+#include "threadpool.h"
+#include "../dependencies/tgaimage.h"
+
+enum class TextureFilter { Nearest, Bilinear, Trilinear };
+
+// BGRA8 texture with a full mip chain. Every level is split into 4x4 texel
+// blocks of 64 bytes, one cache line each, stored row by row, with the texels
+// of a block in Z-order. A bilinear footprint then touches one or two lines
+// instead of two rows of the image.
+//
+// Sample coordinates are in texel units of level 0, the same units Model
+// prepares uvs in, and are clamped to the edge. lod is log2 of the texels
+// per pixel, trilinear filtering blends the two levels around it.
+class Texture {
+public:
+    Texture() = default;
+    // Converts a row-major image with 1, 3 or 4 bytes per pixel and builds the mips
+    Texture(const std::uint8_t *pixels, int width, int height, int bpp, ThreadPool& pool);
+    // Uses texels laid out by another Texture of the same size, e.g. from a mapped cache
+    Texture(ArrayView<std::uint32_t> texels, int width, int height);
+    // mTexels may point into mOwned, moving keeps it valid but copying would not
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+    Texture(Texture&&) = default;
+    Texture& operator=(Texture&&) = default;
+
+    // Texels a width x height texture with all its mips takes
+    static std::size_t storageSize(int width, int height);
+
+    [[nodiscard]] bool empty() const { return mTexels.empty(); }
+    [[nodiscard]] int width() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+    [[nodiscard]] int height() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+    [[nodiscard]] int levels() const { return mLevels.size(); }
+    [[nodiscard]] ArrayView<std::uint32_t> texels() const { return mTexels; }
+
+    [[nodiscard]] std::uint32_t sampleNearest(float u, float v, int level = 0) const;
+    [[nodiscard]] std::uint32_t sampleBilinear(float u, float v, int level = 0) const;
+    [[nodiscard]] std::uint32_t sampleTrilinear(float u, float v, float lod) const;
+    [[nodiscard]] std::uint32_t sample(float u, float v, float lod, TextureFilter filter) const;
+
+    // Samples 4 or 8 pixels sharing one lod, e.g. a span of a triangle. The
+    // results equal sample() lane by lane.
+    void sample4(const float *u, const float *v, float lod, TextureFilter filter, std::uint32_t *out) const;
+    void sample8(const float *u, const float *v, float lod, TextureFilter filter, std::uint32_t *out) const;
+
+    static TGAColor toColor(std::uint32_t bgra) {
+        return TGAColor{ static_cast<std::uint8_t>(bgra >> 16), static_cast<std::uint8_t>(bgra >> 8),
+                         static_cast<std::uint8_t>(bgra), static_cast<std::uint8_t>(bgra >> 24) };
+    }
+
+    struct Level {
+        int width, height;
+        int tilesX;          // 4x4 blocks per row
+        std::size_t offset;  // first texel in the storage
+        float scaleX;        // level 0 texel units to this level's
+        float scaleY;
+    };
+
+private:
+    void setLevels(int width, int height);
+    [[nodiscard]] int levelOf(float lod, float& blend) const;
+
+    std::vector<Level> mLevels;
+    std::vector<std::uint32_t> mOwned;
+    ArrayView<std::uint32_t> mTexels;
+};
+
+#endif //MYRENDERER_TEXTURE_H
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "mappedfile.h"
+#include "simd.h"
+#include "tgareader.h"
+
+namespace {
+
+// Sets count pixels at dst to pixel, a memset or word fill where the size
+// allows, otherwise by doubling the already written part
+void fillPixels(std::uint8_t *dst, const std::uint8_t *pixel, std::size_t count, int bpp) {
+    if (bpp == 1) {
+        std::memset(dst, *pixel, count);
+        return;
+    }
+    if (bpp == 4) {
+        std::uint32_t value;
+        std::memcpy(&value, pixel, sizeof(value));
+        fill32(dst, count, value);
+        return;
+    }
+    const auto total = count * bpp;
+    std::memcpy(dst, pixel, bpp);
+    for (std::size_t done = bpp; done < total; ) {
+        const auto n = std::min(done, total - done);
+        std::memcpy(dst + done, dst, n);
+        done += n;
+    }
+}
+
+void reversePixels(std::uint8_t *row, int width, int bpp) {
+    std::uint8_t tmp[4];
+    for (int i = 0, j = width - 1; i < j; ++i, --j) {
+        std::memcpy(tmp, row + i * bpp, bpp);
+        std::memcpy(row + i * bpp, row + j * bpp, bpp);
+        std::memcpy(row + j * bpp, tmp, bpp);
+    }
+}
+
+}
+
+bool decodeTga(const std::uint8_t *data, std::size_t size, TGAImage& image, RowOrder order) {
+    TGA_Header header;
+    if (size < sizeof(header)) {
+        std::cerr << "an error occured while reading the header\n";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    const int width = header.width;
+    const int height = header.height;
+    const int bpp = header.bitsperpixel >> 3;
+    if (width <= 0 || height <= 0 || (bpp != TGAImage::GRAYSCALE && bpp != TGAImage::RGB && bpp != TGAImage::RGBA)) {
+        std::cerr << "bad bpp (or width/height) value\n";
+        return false;
+    }
+    const auto rle = header.datatypecode == 10 || header.datatypecode == 11;
+    if (!rle && header.datatypecode != 2 && header.datatypecode != 3) {
+        std::cerr << "unknown file format " << static_cast<int>(header.datatypecode) << "\n";
+        return false;
+    }
+
+    // Pixels follow the image id and the color map, neither is used
+    const auto skip = sizeof(header) + header.idlength +
+                      (header.colormaptype ? std::size_t{ header.colormaplength } * ((header.colormapdepth + 7) / 8) : 0);
+    const auto *p = data + std::min(skip, size);
+    const auto *end = data + size;
+
+    image = TGAImage(width, height, bpp);
+    const auto rowBytes = static_cast<std::size_t>(width) * bpp;
+    // Without bit 5 the file stores the bottom row first
+    const auto flipRows = !(header.imagedescriptor & 0x20) != (order == RowOrder::BottomUp);
+    const auto rightToLeft = (header.imagedescriptor & 0x10) != 0;
+    const auto rowStart = [&](int row) {
+        return image.buffer() + (flipRows ? height - 1 - row : row) * rowBytes;
+    };
+
+    if (!rle) {
+        if (static_cast<std::size_t>(end - p) < rowBytes * height) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+        for (int row = 0; row < height; ++row, p += rowBytes) {
+            auto *dst = rowStart(row);
+            std::memcpy(dst, p, rowBytes);
+            if (rightToLeft) reversePixels(dst, width, bpp);
+        }
+        return true;
+    }
+
+    // Packets may run across row ends, they are cut into per-row pieces
+    auto row = 0;
+    auto x = 0;
+    auto *dst = rowStart(0);
+    while (row < height) {
+        if (p >= end) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+        const auto packet = *p++;
+        auto count = (packet & 0x7f) + 1;
+        const auto run = (packet & 0x80) != 0;
+        const auto bytes = static_cast<std::size_t>(run ? 1 : count) * bpp;
+        if (static_cast<std::size_t>(end - p) < bytes) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+        const auto *src = p;
+        p += bytes;
+        while (count > 0) {
+            if (row == height) {
+                std::cerr << "Too many pixels read\n";
+                return false;
+            }
+            const auto n = std::min(count, width - x);
+            if (run) {
+                fillPixels(dst + x * bpp, src, n, bpp);
+            } else {
+                std::memcpy(dst + x * bpp, src, static_cast<std::size_t>(n) * bpp);
+                src += static_cast<std::size_t>(n) * bpp;
+            }
+            x += n;
+            count -= n;
+            if (x == width) {
+                if (rightToLeft) reversePixels(dst, width, bpp);
+                x = 0;
+                if (++row < height) dst = rowStart(row);
+            }
+        }
+    }
+    return true;
+}
+
+bool readTga(const std::string& filename, TGAImage& image, RowOrder order) {
+    const MappedFile file{ filename };
+    if (!file.isOpen()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    return decodeTga(reinterpret_cast<const std::uint8_t *>(file.data()), file.size(), image, order);
+}
@@ -0,0 +1,23 @@
+#ifndef MYRENDERER_TGAREADER_H
+#define MYRENDERER_TGAREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../dependencies/tgaimage.h"
+
+// Row order a decoded image is wanted in. TopDown is what
+// TGAImage::read_tga_file returns, BottomUp puts the last row of the picture
+// first, the way texture coordinates count v.
+enum class RowOrder { TopDown, BottomUp };
+
+// Decodes an uncompressed or RLE TGA file with 8, 24 or 32 bits per pixel.
+// Every row is written straight to where order puts it, whatever origin the
+// file was stored with, so the image never needs flipping afterwards.
+bool decodeTga(const std::uint8_t *data, std::size_t size, TGAImage& image, RowOrder order = RowOrder::TopDown);
+
+// Maps filename and decodes it in place, without reading it through a stream
+bool readTga(const std::string& filename, TGAImage& image, RowOrder order = RowOrder::TopDown);
+
+#endif //MYRENDERER_TGAREADER_H
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "profiler.h"
+#include "simd.h"
+#include "tgawriter.h"
+
+namespace {
+
+const int MAX_PACKET = 128;
+// Pixels per parallelFor item, a multiple of 64 so items own whole words of the run bits
+const std::size_t CHUNK_PIXELS = 1 << 16;
+
+// Developer and extension area offsets, both unused, then the TGA 2.0 signature
+const std::uint8_t FOOTER[26] = { 0, 0, 0, 0, 0, 0, 0, 0,
+                                  'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O', 'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0' };
+
+// Bit k set when pixel k at p equals pixel k + 1, for k in [from, count)
+std::uint64_t equalBitsScalar(const std::uint8_t *p, int bpp, int from, int count) {
+    std::uint64_t bits = 0;
+    for (int k = from; k < count; ++k) {
+        if (!std::memcmp(p + k * bpp, p + (k + 1) * bpp, bpp)) bits |= std::uint64_t{ 1 } << k;
+    }
+    return bits;
+}
+
+#ifdef MYRENDERER_X86
+// 32-bit and grayscale pixels compare a vector at a time, 24-bit ones are left to the scalar loop
+MYRENDERER_TARGET("sse2")
+std::uint64_t equalBitsSSE2(const std::uint8_t *p, int bpp, int count) {
+    std::uint64_t bits = 0;
+    auto k = 0;
+    if (bpp == 4) {
+        for (; k + 4 <= count; k += 4) {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k * 4));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k * 4 + 4));
+            const auto mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+            bits |= static_cast<std::uint64_t>(mask) << k;
+        }
+    } else if (bpp == 1) {
+        for (; k + 16 <= count; k += 16) {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k + 1));
+            const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+            bits |= static_cast<std::uint64_t>(mask) << k;
+        }
+    }
+    return bits | equalBitsScalar(p, bpp, k, count);
+}
+#endif
+
+// Bit i: pixel i equals pixel i + 1, never set for the last pixel
+std::vector<std::uint64_t> equalBits(const std::uint8_t *pixels, std::size_t npixels, int bpp, ThreadPool& pool) {
+    std::vector<std::uint64_t> bits((npixels + 63) / 64);
+    const auto chunks = static_cast<int>((npixels + CHUNK_PIXELS - 1) / CHUNK_PIXELS);
+    pool.parallelFor(chunks, [&](int c) {
+        const auto wordEnd = std::min(bits.size(), (c + 1) * CHUNK_PIXELS / 64);
+        for (auto w = c * CHUNK_PIXELS / 64; w < wordEnd; ++w) {
+            const auto base = w * 64;
+            const auto count = static_cast<int>(std::min<std::size_t>(64, npixels - 1 - base));
+            const auto *p = pixels + base * bpp;
+#ifdef MYRENDERER_X86
+            if (simdLevel() >= SimdLevel::SSE2) {
+                bits[w] = equalBitsSSE2(p, bpp, count);
+                continue;
+            }
+#endif
+            bits[w] = equalBitsScalar(p, bpp, 0, count);
+        }
+    });
+    return bits;
+}
+
+inline bool bitAt(const std::vector<std::uint64_t>& bits, std::size_t i) {
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+// 64 bits from bit p on, bits past the end read as zero
+inline std::uint64_t window(const std::vector<std::uint64_t>& bits, std::size_t p) {
+    const auto word = p >> 6;
+    const auto shift = p & 63;
+    auto res = bits[word] >> shift;
+    if (shift && word + 1 < bits.size()) res |= bits[word + 1] << (64 - shift);
+    return res;
+}
+
+// Number of consecutive bits equal to value from bit p on, at most limit
+int stretch(const std::vector<std::uint64_t>& bits, std::size_t p, bool value, int limit) {
+    for (auto len = 0; len < limit; len += 64) {
+        const auto word = window(bits, p + len);
+        const auto other = value ? ~word : word;
+        if (other) return std::min(len + lowestBit64(other), limit);
+    }
+    return limit;
+}
+
+inline int packetLength(std::uint8_t header) {
+    return header < MAX_PACKET ? header + 1 : header - 127;
+}
+
+inline std::size_t packetSize(std::uint8_t header, int bpp) {
+    return 1 + static_cast<std::size_t>(header < MAX_PACKET ? header + 1 : 1) * bpp;
+}
+
+inline std::uint8_t* writePacket(std::uint8_t *out, std::uint8_t header, const std::uint8_t *pixels, int bpp) {
+    *out++ = header;
+    const auto bytes = static_cast<std::size_t>(header < MAX_PACKET ? header + 1 : 1) * bpp;
+    std::memcpy(out, pixels, bytes);
+    return out + bytes;
+}
+
+// Header of the packet the legacy encoder starts at pixel p: a raw packet
+// ends before the first pixel that repeats, a run ends at the first change,
+// and neither is checked again once it reaches 128 pixels or the image end
+std::uint8_t legacyPacket(const std::vector<std::uint64_t>& bits, std::size_t p, std::size_t npixels) {
+    const auto limit = static_cast<int>(std::min<std::size_t>(MAX_PACKET, npixels - p));
+    if (limit == 1) return 0;
+    if (!bitAt(bits, p)) {
+        const auto different = stretch(bits, p, false, limit);
+        return static_cast<std::uint8_t>((different + 1 < limit ? different : limit) - 1);
+    }
+    const auto same = stretch(bits, p, true, limit - 1);
+    return static_cast<std::uint8_t>(std::min(same + 1, limit) + 127);
+}
+
+// The encoders write the packets at offset and leave room for the footer behind them
+std::size_t encodeLegacy(const std::uint8_t *pixels, std::size_t npixels, int bpp, const std::vector<std::uint64_t>& bits,
+                         std::vector<std::uint8_t>& out, std::size_t offset, ThreadPool& pool) {
+    // Every packet depends on the one before, so they are found in a
+    // sequential pass over the run bits, which also records where each chunk
+    // starts in the pixels, the headers and the output. The chunks are then
+    // written in parallel.
+    const auto chunks = static_cast<int>((npixels + CHUNK_PIXELS - 1) / CHUNK_PIXELS);
+    std::vector<std::size_t> starts(chunks + 1, npixels);
+    std::vector<std::size_t> firstHeader(chunks + 1);
+    std::vector<std::size_t> offsets(chunks + 1);
+    std::unique_ptr<std::uint8_t[]> headers{ new std::uint8_t[npixels] };
+    std::size_t size = 0;
+    std::size_t count = 0;
+    auto chunk = 0;
+    for (std::size_t p = 0; p < npixels; ) {
+        while (chunk < chunks && p >= chunk * CHUNK_PIXELS) {
+            starts[chunk] = p;
+            firstHeader[chunk] = count;
+            offsets[chunk++] = size;
+        }
+        const auto header = legacyPacket(bits, p, npixels);
+        headers[count++] = header;
+        size += packetSize(header, bpp);
+        p += packetLength(header);
+    }
+    for (; chunk <= chunks; ++chunk) {
+        firstHeader[chunk] = count;
+        offsets[chunk] = size;
+    }
+
+    out.resize(offset + size + sizeof(FOOTER));
+    pool.parallelFor(chunks, [&](int c) {
+        auto *dst = out.data() + offset + offsets[c];
+        const auto *src = pixels + starts[c] * bpp;
+        for (auto h = firstHeader[c]; h < firstHeader[c + 1]; ++h) {
+            dst = writePacket(dst, headers[h], src, bpp);
+            src += static_cast<std::size_t>(packetLength(headers[h])) * bpp;
+        }
+    });
+    return size;
+}
+
+struct RowPlanner {
+    std::vector<std::int64_t> cost; // bytes for the first i pixels of the row
+    std::vector<std::uint8_t> last; // header of the last packet of that encoding
+    std::vector<int> rawQueue;
+    std::vector<int> runQueue;
+
+    // Shortest packet sequence for the width pixels from pixel first on, by
+    // dynamic programming over the row. A raw packet ending before pixel i
+    // may start at any of the 128 pixels before it, a run packet only inside
+    // the run of equal pixels i - 1 belongs to; both windows slide with i, so
+    // their minimum is kept in monotonic queues. Returns the encoded size.
+    std::size_t plan(const std::vector<std::uint64_t>& bits, std::size_t first, int width, int bpp, std::vector<std::uint8_t>& headers) {
+        cost.assign(width + 1, 0);
+        last.assign(width + 1, 0);
+        rawQueue.resize(width + 1);
+        runQueue.resize(width + 1);
+        auto rawHead = 0, rawTail = 0, runHead = 0, runTail = 0;
+        const auto rawKey = [&](int j) { return cost[j] - std::int64_t{ j } * bpp; };
+        for (int i = 1; i <= width; ++i) {
+            const auto j = i - 1;
+            while (rawTail > rawHead && rawKey(rawQueue[rawTail - 1]) >= rawKey(j)) --rawTail;
+            rawQueue[rawTail++] = j;
+            while (rawQueue[rawHead] < i - MAX_PACKET) ++rawHead;
+            const auto from = rawQueue[rawHead];
+            auto best = cost[from] + std::int64_t{ i - from } * bpp + 1;
+            auto header = static_cast<std::uint8_t>(i - from - 1);
+
+            if (i >= 2 && bitAt(bits, first + i - 2)) {
+                const auto k = i - 2;
+                while (runTail > runHead && cost[runQueue[runTail - 1]] >= cost[k]) --runTail;
+                runQueue[runTail++] = k;
+                while (runQueue[runHead] < i - MAX_PACKET) ++runHead;
+                const auto start = runQueue[runHead];
+                if (cost[start] + 1 + bpp <= best) {
+                    best = cost[start] + 1 + bpp;
+                    header = static_cast<std::uint8_t>(i - start + 127);
+                }
+            } else {
+                runHead = runTail = 0;
+            }
+            cost[i] = best;
+            last[i] = header;
+        }
+        headers.clear();
+        for (int i = width; i > 0; i -= packetLength(last[i])) {
+            headers.push_back(last[i]);
+        }
+        std::reverse(headers.begin(), headers.end());
+        return static_cast<std::size_t>(cost[width]);
+    }
+};
+
+std::size_t encodeOptimal(const std::uint8_t *pixels, int width, int height, int bpp, const std::vector<std::uint64_t>& bits,
+                          std::vector<std::uint8_t>& out, std::size_t offset, ThreadPool& pool) {
+    const auto rowsPerItem = std::max(1, static_cast<int>(CHUNK_PIXELS / width));
+    const auto items = (height + rowsPerItem - 1) / rowsPerItem;
+    std::vector<std::vector<std::uint8_t>> headers(height);
+    std::vector<std::size_t> offsets(height + 1);
+    pool.parallelFor(items, [&](int item) {
+        RowPlanner planner;
+        for (int y = item * rowsPerItem; y < std::min(height, (item + 1) * rowsPerItem); ++y) {
+            offsets[y + 1] = planner.plan(bits, static_cast<std::size_t>(y) * width, width, bpp, headers[y]);
+        }
+    });
+    for (int y = 0; y < height; ++y) {
+        offsets[y + 1] += offsets[y];
+    }
+
+    out.resize(offset + offsets[height] + sizeof(FOOTER));
+    pool.parallelFor(items, [&](int item) {
+        for (int y = item * rowsPerItem; y < std::min(height, (item + 1) * rowsPerItem); ++y) {
+            auto *dst = out.data() + offset + offsets[y];
+            const auto *src = pixels + static_cast<std::size_t>(y) * width * bpp;
+            for (const auto header: headers[y]) {
+                dst = writePacket(dst, header, src, bpp);
+                src += static_cast<std::size_t>(packetLength(header)) * bpp;
+            }
+        }
+    });
+    return offsets[height];
+}
+
+}
+
+std::vector<std::uint8_t> encodeTga(const std::uint8_t *pixels, int width, int height, int bpp,
+                                    const TgaWriteOptions& options, ThreadPool& pool) {
+    if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff ||
+        (bpp != TGAImage::GRAYSCALE && bpp != TGAImage::RGB && bpp != TGAImage::RGBA)) return {};
+
+    TGA_Header header;
+    header.bitsperpixel = bpp << 3;
+    header.width = width;
+    header.height = height;
+    header.datatypecode = bpp == TGAImage::GRAYSCALE ? (options.rle ? 11 : 3) : (options.rle ? 10 : 2);
+    header.imagedescriptor = options.vflip ? 0x00 : 0x20;
+
+    const auto npixels = static_cast<std::size_t>(width) * height;
+    std::vector<std::uint8_t> out(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::size_t size;
+    if (!options.rle) {
+        size = npixels * bpp;
+        out.resize(sizeof(header) + size + sizeof(FOOTER));
+        std::memcpy(out.data() + sizeof(header), pixels, size);
+    } else {
+        const auto bits = equalBits(pixels, npixels, bpp, pool);
+        size = options.packets == TgaPackets::Optimal ? encodeOptimal(pixels, width, height, bpp, bits, out, sizeof(header), pool)
+                                                      : encodeLegacy(pixels, npixels, bpp, bits, out, sizeof(header), pool);
+    }
+    std::memcpy(out.data() + sizeof(header) + size, FOOTER, sizeof(FOOTER));
+    return out;
+}
+
+bool writeTga(const std::string& filename, const TGAImage& image, const TgaWriteOptions& options, ThreadPool& pool) {
+    PROFILE_SCOPE("write tga");
+    const auto file = encodeTga(image.buffer(), image.get_width(), image.get_height(), image.get_bytespp(), options, pool);
+    if (file.empty()) {
+        std::cerr << "can't encode a " << image.get_width() << "x" << image.get_height() << "/" << image.get_bytespp() * 8 << " image\n";
+        return false;
+    }
+    auto *out = std::fopen(filename.c_str(), "wb");
+    if (!out) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    // Unbuffered, the whole file goes to the OS in one call
+    std::setvbuf(out, nullptr, _IONBF, 0);
+    const auto written = std::fwrite(file.data(), 1, file.size(), out);
+    if (std::fclose(out) != 0 || written != file.size()) {
+        std::cerr << "can't dump the tga file " << filename << "\n";
+        return false;
+    }
+    profile::count(profile::Counter::BytesWritten, file.size());
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef MYRENDERER_TGAWRITER_H
+#define MYRENDERER_TGAWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+#include "../dependencies/tgaimage.h"
+
+enum class TgaPackets {
+    Legacy,  // the packets of TGAImage::write_tga_file, byte for byte, they may cross rows
+    Optimal, // the smallest encoding with every packet inside one scanline
+};
+
+struct TgaWriteOptions {
+    bool rle = true;
+    bool vflip = true; // same meaning as in TGAImage::write_tga_file: rows are stored bottom-up
+    TgaPackets packets = TgaPackets::Legacy;
+};
+
+// Encodes width x height pixels of bpp bytes, stored row by row as in a
+// TGAImage, into a complete TGA file in memory. Pixel runs are found with
+// SIMD compares and both the run detection and the packet output are split
+// across the pool.
+std::vector<std::uint8_t> encodeTga(const std::uint8_t *pixels, int width, int height, int bpp,
+                                    const TgaWriteOptions& options, ThreadPool& pool);
+
+// encodeTga() followed by a single write of the whole file
+bool writeTga(const std::string& filename, const TGAImage& image, const TgaWriteOptions& options, ThreadPool& pool);
+
+#endif //MYRENDERER_TGAWRITER_H
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "profiler.h"
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 1; i < threads; ++i) {
+        mWorkers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto& worker: mWorkers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::runJob(const std::function<void(int)>& fn, int count) {
+    for (auto i = mNext++; i < count; i = mNext++) {
+        fn(i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    profile::setThreadName("pool worker");
+    auto seen = 0u;
+    for (;;) {
+        const std::function<void(int)>* job = nullptr;
+        auto count = 0;
+        {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mWake.wait(lock, [&] { return mStop || mGeneration != seen; });
+            if (mStop) return;
+            seen = mGeneration;
+            if (!mJob) continue; // woke up after the job was already finished
+            job = mJob;
+            count = mJobSize;
+            ++mBusy;
+        }
+        runJob(*job, count);
+        {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            --mBusy;
+        }
+        mDone.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+    if (mWorkers.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mJob = &fn;
+        mJobSize = count;
+        mNext = 0;
+        ++mGeneration;
+    }
+    mWake.notify_all();
+    runJob(fn, count);
+
+    // Workers only pick up the job under the lock, so once nobody is busy
+    // and mJob is reset no thread can touch fn any more
+    std::unique_lock<std::mutex> lock{ mMutex };
+    mDone.wait(lock, [&] { return mBusy == 0; });
+    mJob = nullptr;
+    mJobSize = 0;
+}
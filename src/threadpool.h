@@ -0,0 +1,42 @@
+#ifndef MYRENDERER_THREADPOOL_H
+#define MYRENDERER_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads. The calling thread takes part in every
+// parallelFor, so a pool of size 1 runs everything inline with no workers.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = 0); // 0 means one thread per hardware core
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] int size() const { return static_cast<int>(mWorkers.size()) + 1; }
+
+    // Calls fn(i) for every i in [0, count) and blocks until all calls returned
+    void parallelFor(int count, const std::function<void(int)>& fn);
+
+private:
+    void workerLoop();
+    void runJob(const std::function<void(int)>& fn, int count);
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+
+    const std::function<void(int)>* mJob = nullptr;
+    int mJobSize = 0;
+    std::atomic<int> mNext{ 0 };
+    int mBusy = 0;
+    unsigned mGeneration = 0;
+    bool mStop = false;
+};
+
+#endif //MYRENDERER_THREADPOOL_H
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cassert>
+
+#include "msaa.h"
+#include "tilerenderer.h"
+
+TileRenderer::TileRenderer(int width, int height, ThreadPool& pool, int tileSize) : mWidth(width), mHeight(height),
+                                                                                    mTileSize(tileSize),
+                                                                                    mTilesX((width + tileSize - 1) / tileSize),
+                                                                                    mTilesY((height + tileSize - 1) / tileSize),
+                                                                                    mPool(pool),
+                                                                                    mBins(mTilesX * mTilesY) {
+    // Depth blocks must not straddle tiles, each one is owned by a single thread
+    assert(tileSize % DepthBuffer::BLOCK == 0);
+}
+
+bool TileRenderer::submit(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, std::uint32_t id) {
+    TriangleSetup setup;
+    if (!setupTriangle(pts, ity, Rect{ 0, 0, mWidth, mHeight }, setup, mSampleMargin)) return false;
+
+    const auto idx = static_cast<int>(mTriangles.size());
+    mTriangles.push_back(setup);
+    mIds.push_back(id);
+    for (int ty = setup.bbox.y0 / mTileSize; ty <= (setup.bbox.y1 - 1) / mTileSize; ++ty) {
+        for (int tx = setup.bbox.x0 / mTileSize; tx <= (setup.bbox.x1 - 1) / mTileSize; ++tx) {
+            mBins[tx + ty * mTilesX].push_back(idx);
+        }
+    }
+    return true;
+}
+
+Rect TileRenderer::tileRect(int tile) const {
+    const auto x0 = (tile % mTilesX) * mTileSize;
+    const auto y0 = (tile / mTilesX) * mTileSize;
+    return Rect{ x0, y0, std::min(x0 + mTileSize, mWidth), std::min(y0 + mTileSize, mHeight) };
+}
+
+void TileRenderer::render(Framebuffer& frame, DepthBuffer& depth) {
+    const TGAColor white{ 255, 255, 255 };
+    renderWith(depth, [&](int idx, const Rect& clip) {
+        return rasterize(mTriangles[idx], clip, depth.data(), frame, white);
+    });
+}
+
+void TileRenderer::renderVisibility(VisibilitySample *vis, DepthBuffer& depth) {
+    renderWith(depth, [&](int idx, const Rect& clip) {
+        return rasterizeVisibility(mTriangles[idx], mIds[idx], clip, depth.data(), vis, mWidth);
+    });
+}
+
+void TileRenderer::renderDepth(DepthBuffer& depth, int first) {
+    renderWith(depth, [&](int idx, const Rect& clip) {
+        return rasterizeDepth(mTriangles[idx], clip, depth.data(), mWidth);
+    }, first);
+}
+
+void TileRenderer::renderMultisample(MsaaBuffer& target, DepthBuffer& depth) {
+    const TGAColor white{ 255, 255, 255 };
+    renderWith(depth, [&](int idx, const Rect& clip) {
+        return rasterizeMultisample(mTriangles[idx], clip, target, depth.data(), white);
+    });
+}
+
+void TileRenderer::clear() {
+    mTriangles.clear();
+    mIds.clear();
+    for (auto& bin: mBins) {
+        bin.clear();
+    }
+}
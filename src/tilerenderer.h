@@ -0,0 +1,122 @@
+#ifndef MYRENDERER_TILERENDERER_H
+#define MYRENDERER_TILERENDERER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "depthbuffer.h"
+#include "profiler.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+class MsaaBuffer;
+
+// Sort-middle rasterizer: submitted triangles are binned into square screen
+// tiles, then the tiles are rasterized in parallel. Every tile owns its part
+// of the framebuffer and z-buffer and draws its triangles in submission order, so
+// the output does not depend on the number of threads.
+// Inside a tile, triangles and 8x8 depth blocks that are already hidden are
+// skipped using the coarse level of the depth buffer.
+class TileRenderer {
+public:
+    // Counted per triangle and tile it was binned into
+    struct Stats {
+        std::int64_t triangles = 0;
+        std::int64_t rejectedTriangles = 0;
+        std::int64_t blocks = 0;
+        std::int64_t rejectedBlocks = 0;
+        std::int64_t fragments = 0; // pixels that passed the depth test
+    };
+
+    TileRenderer(int width, int height, ThreadPool& pool, int tileSize = 64);
+
+    // id is what renderVisibility() stores for the pixels of the triangle.
+    // False when the triangle covers no pixel centers and was dropped.
+    bool submit(const std::array<Vec3f, 3>& pts, const std::array<float, 3>& ity, std::uint32_t id = 0);
+    void render(Framebuffer& frame, DepthBuffer& depth);
+    // Depth and visibility only, vis is a width x height buffer
+    void renderVisibility(VisibilitySample *vis, DepthBuffer& depth);
+    // Depth only, e.g. a shadow map or a depth prepass, of the triangles from first on
+    void renderDepth(DepthBuffer& depth, int first = 0);
+    // Into the samples of target, depth gets the farthest sample of each pixel.
+    // Triangles must have been submitted with the sample pattern's reach as margin.
+    void renderMultisample(MsaaBuffer& target, DepthBuffer& depth);
+    // Tile loop of all of them, raster(i, clip) draws submitted triangle i into
+    // clip and returns the pixels that passed the depth test. Triangles
+    // submitted before first are skipped.
+    template <class Raster>
+    void renderWith(DepthBuffer& depth, const Raster& raster, int first = 0);
+    // Drops the submitted triangles, stats keep adding up until resetStats()
+    void clear();
+    void resetStats() { mStats = Stats{}; }
+    // Subpixels around each pixel center that count for coverage, see setupTriangle()
+    void setSampleMargin(int margin) { mSampleMargin = margin; }
+
+    [[nodiscard]] int ntriangles() const { return mTriangles.size(); }
+    [[nodiscard]] const TriangleSetup& triangle(int i) const { return mTriangles[i]; }
+    [[nodiscard]] std::uint32_t id(int i) const { return mIds[i]; }
+    [[nodiscard]] int ntiles() const { return mBins.size(); }
+    [[nodiscard]] const Stats& stats() const { return mStats; }
+
+private:
+    [[nodiscard]] Rect tileRect(int tile) const;
+
+    int mWidth;
+    int mHeight;
+    int mTileSize;
+    int mTilesX;
+    int mTilesY;
+    ThreadPool& mPool;
+    int mSampleMargin = 0;
+    std::vector<TriangleSetup> mTriangles;
+    std::vector<std::uint32_t> mIds;
+    std::vector<std::vector<int>> mBins; // triangle indices per tile, in submission order
+    Stats mStats;
+};
+
+template <class Raster>
+void TileRenderer::renderWith(DepthBuffer& depth, const Raster& raster, int first) {
+    const auto B = DepthBuffer::BLOCK;
+    std::mutex statsMutex;
+    mPool.parallelFor(ntiles(), [&](int tile) {
+        PROFILE_SCOPE("tile");
+        const auto clip = tileRect(tile);
+        Stats stats;
+        const auto& bin = mBins[tile];
+        for (auto it = std::lower_bound(bin.begin(), bin.end(), first); it != bin.end(); ++it) {
+            const auto idx = *it;
+            const auto& s = mTriangles[idx];
+            const Rect r{ std::max(s.bbox.x0, clip.x0), std::max(s.bbox.y0, clip.y0),
+                          std::min(s.bbox.x1, clip.x1), std::min(s.bbox.y1, clip.y1) };
+            auto visible = 0;
+            for (int by = r.y0 / B; by <= (r.y1 - 1) / B; ++by) {
+                for (int bx = r.x0 / B; bx <= (r.x1 - 1) / B; ++bx) {
+                    ++stats.blocks;
+                    // Every pixel of the block already holds a depth the triangle can't beat
+                    if (depth.blockFar(bx, by) >= s.zmax) {
+                        ++stats.rejectedBlocks;
+                        continue;
+                    }
+                    stats.fragments += raster(idx, depth.blockRect(bx, by));
+                    depth.markDirty(bx, by);
+                    ++visible;
+                }
+            }
+            ++stats.triangles;
+            if (!visible) ++stats.rejectedTriangles;
+        }
+        std::lock_guard<std::mutex> lock{ statsMutex };
+        mStats.triangles += stats.triangles;
+        mStats.rejectedTriangles += stats.rejectedTriangles;
+        mStats.blocks += stats.blocks;
+        mStats.rejectedBlocks += stats.rejectedBlocks;
+        mStats.fragments += stats.fragments;
+    });
+}
+
+#endif //MYRENDERER_TILERENDERER_H
@@ -0,0 +1,165 @@
+#include <algorithm>
+
+#include "simd.h"
+#include "vertexstage.h"
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "the AVX2 gather assumes tightly packed vertices");
+
+namespace {
+
+// Vertices per parallelFor item, large enough to hide the scheduling cost
+const int BATCH_SIZE = 4096;
+
+struct Batch {
+    const Vec3f *in;
+    float *x, *y, *z, *w;
+    std::uint8_t *codes;
+    int begin, end;
+};
+
+// Same operation order as Mat4f * Vec4f, so every kernel gives the result
+// of the per-vertex path bit for bit
+void transformScalar(const Mat4f& m, const Batch& b, int from) {
+    for (int i = from; i < b.end; ++i) {
+        const auto& v = b.in[i];
+        b.x[i] = m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z + m[0][3]*1.f;
+        b.y[i] = m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z + m[1][3]*1.f;
+        b.z[i] = m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z + m[2][3]*1.f;
+        b.w[i] = m[3][0]*v.x + m[3][1]*v.y + m[3][2]*v.z + m[3][3]*1.f;
+    }
+}
+
+void classify(const Batch& b, const Rect& viewport) {
+    for (int i = b.begin; i < b.end; ++i) {
+        b.codes[i] = computeClipCode(b.x[i], b.y[i], b.w[i], viewport);
+    }
+}
+
+#ifdef MYRENDERER_X86
+MYRENDERER_TARGET("sse2")
+void transformSSE2(const Mat4f& m, const Batch& b) {
+    const auto end = b.begin + ((b.end - b.begin) & ~3);
+    for (int i = b.begin; i < end; i += 4) {
+        const auto *v = b.in + i;
+        const auto x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+        const auto y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+        const auto z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+        __m128 r[4];
+        for (int k = 0; k < 4; ++k) {
+            r[k] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[k][0]), x),
+                                                    _mm_mul_ps(_mm_set1_ps(m[k][1]), y)),
+                                         _mm_mul_ps(_mm_set1_ps(m[k][2]), z)),
+                              _mm_set1_ps(m[k][3]));
+        }
+        _mm_storeu_ps(b.x + i, r[0]);
+        _mm_storeu_ps(b.y + i, r[1]);
+        _mm_storeu_ps(b.z + i, r[2]);
+        _mm_storeu_ps(b.w + i, r[3]);
+    }
+    transformScalar(m, b, end);
+}
+
+// Gathers 8 vertices at a time straight out of the Vec3f array
+MYRENDERER_TARGET("avx2")
+void transformAVX2(const Mat4f& m, const Batch& b) {
+    const auto stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const auto end = b.begin + ((b.end - b.begin) & ~7);
+    for (int i = b.begin; i < end; i += 8) {
+        const auto *base = &b.in[i].x;
+        const auto x = _mm256_i32gather_ps(base,     stride, 4);
+        const auto y = _mm256_i32gather_ps(base + 1, stride, 4);
+        const auto z = _mm256_i32gather_ps(base + 2, stride, 4);
+        __m256 r[4];
+        for (int k = 0; k < 4; ++k) {
+            r[k] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[k][0]), x),
+                                                             _mm256_mul_ps(_mm256_set1_ps(m[k][1]), y)),
+                                               _mm256_mul_ps(_mm256_set1_ps(m[k][2]), z)),
+                                 _mm256_set1_ps(m[k][3]));
+        }
+        _mm256_storeu_ps(b.x + i, r[0]);
+        _mm256_storeu_ps(b.y + i, r[1]);
+        _mm256_storeu_ps(b.z + i, r[2]);
+        _mm256_storeu_ps(b.w + i, r[3]);
+    }
+    transformScalar(m, b, end);
+}
+#endif
+
+}
+
+void VertexStage::run(const Model& model, const Mat4f& transform, const Rect& viewport) {
+    begin(model, transform, viewport);
+    mRanges.assign(1, Range{ 0, model.nverts() });
+    this->transform(mRanges);
+}
+
+void VertexStage::begin(const Model& model, const Mat4f& transform, const Rect& viewport) {
+    const auto n = model.nverts();
+    mModel = &model;
+    mTransform = transform;
+    mViewport = viewport;
+    mX.resize(n);
+    mY.resize(n);
+    mZ.resize(n);
+    mW.resize(n);
+    mCodes.resize(n);
+    mStamps.resize(n);
+    if (++mFrame == 0) {
+        std::fill(mStamps.begin(), mStamps.end(), 0);
+        mFrame = 1;
+    }
+    mQueued.clear();
+    mStats = Stats{};
+}
+
+void VertexStage::addFaces(int first, int count) {
+    const auto indices = mModel->vertIndices();
+    for (int i = first * 3; i < (first + count) * 3; ++i) {
+        const auto v = indices[i];
+        if (mStamps[v] != mFrame) {
+            mStamps[v] = mFrame;
+            mQueued.push_back(v);
+        }
+    }
+}
+
+void VertexStage::flush() {
+    // Faces number their vertices in first use order, so the queue is mostly
+    // runs of consecutive indices the batch kernels can stream through
+    std::sort(mQueued.begin(), mQueued.end());
+    mRanges.clear();
+    for (const auto v: mQueued) {
+        if (!mRanges.empty() && mRanges.back().end == v) {
+            ++mRanges.back().end;
+        } else {
+            mRanges.push_back(Range{ v, v + 1 });
+        }
+    }
+    mQueued.clear();
+    transform(mRanges);
+}
+
+void VertexStage::transform(const std::vector<Range>& ranges) {
+    std::vector<Range> batches;
+    for (const auto& r: ranges) {
+        for (int i = r.begin; i < r.end; i += BATCH_SIZE) {
+            batches.push_back(Range{ i, std::min(r.end, i + BATCH_SIZE) });
+        }
+        mStats.transformed += r.end - r.begin;
+    }
+
+    mPool.parallelFor(static_cast<int>(batches.size()), [&](int batch) {
+        const Batch b{ mModel->verts(), mX.data(), mY.data(), mZ.data(), mW.data(), mCodes.data(),
+                       batches[batch].begin, batches[batch].end };
+#ifdef MYRENDERER_X86
+        switch (simdLevel()) {
+            case SimdLevel::AVX2: transformAVX2(mTransform, b); break;
+            case SimdLevel::SSE2: transformSSE2(mTransform, b); break;
+            default: transformScalar(mTransform, b, b.begin); break;
+        }
+#else
+        transformScalar(mTransform, b, b.begin);
+#endif
+        classify(b, mViewport);
+    });
+}
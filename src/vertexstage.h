@@ -0,0 +1,106 @@
+#ifndef MYRENDERER_VERTEXSTAGE_H
+#define MYRENDERER_VERTEXSTAGE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+// Bits of a vertex clip code. The first five are the half-spaces bounding the
+// view frustum, a triangle outside one of them with all three corners is culled.
+// NEAR and GUARD are the planes primitive assembly has to clip against.
+enum ClipCode : std::uint8_t {
+    CLIP_LEFT   = 1 << 0,
+    CLIP_RIGHT  = 1 << 1,
+    CLIP_BOTTOM = 1 << 2,
+    CLIP_TOP    = 1 << 3,
+    CLIP_NEAR   = 1 << 4,
+    CLIP_GUARD  = 1 << 5, // outside one of the guard band planes
+    CLIP_FRUSTUM = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR,
+    CLIP_NEEDED  = CLIP_NEAR | CLIP_GUARD,
+};
+
+// Smallest clip-space w kept, it is the distance to the eye in units of the
+// eye to center distance for the projection built in main()
+constexpr float NEAR_W = 1e-2f;
+// Clipping bound in pixels, half of what setupTriangle accepts so vertices
+// landing on it after the divide are well inside
+constexpr float CLIP_GUARD_BAND = GUARD_BAND / 2;
+
+// Every plane is a linear function of the clip-space position, so a triangle
+// with all corners on the outer side of the same plane is outside entirely
+inline std::uint8_t computeClipCode(float x, float y, float w, const Rect& viewport) {
+    const auto guard = CLIP_GUARD_BAND * w;
+    return (x < viewport.x0 * w ? CLIP_LEFT : 0) |
+           (x > viewport.x1 * w ? CLIP_RIGHT : 0) |
+           (y < viewport.y0 * w ? CLIP_BOTTOM : 0) |
+           (y > viewport.y1 * w ? CLIP_TOP : 0) |
+           (w < NEAR_W ? CLIP_NEAR : 0) |
+           (x < -guard || x > guard || y < -guard || y > guard ? CLIP_GUARD : 0);
+}
+
+// Transforms the vertices of a model once per frame into a structure-of-arrays
+// clip-space buffer and classifies them against the frustum and the guard band.
+// Primitive assembly then reads positions by index instead of transforming
+// the three corners of each face again. A frame either transforms every vertex
+// with run(), or only those of the faces passed to addFaces() between begin()
+// and flush().
+class VertexStage {
+public:
+    struct Stats {
+        long transformed = 0; // vertices pushed through the transform
+        long fetched = 0;     // positions read back by primitive assembly
+
+        [[nodiscard]] long reused() const { return fetched - transformed; }
+    };
+
+    explicit VertexStage(ThreadPool& pool) : mPool(pool) {}
+
+    // Applies transform to all vertices of model, viewport is the screen
+    // rectangle transform maps the visible part of the scene to
+    void run(const Model& model, const Mat4f& transform, const Rect& viewport);
+
+    void begin(const Model& model, const Mat4f& transform, const Rect& viewport);
+    // Queues the vertices of faces [first, first + count) not transformed yet this frame
+    void addFaces(int first, int count);
+    // Transforms the queued vertices
+    void flush();
+
+    // Screen position after the perspective divide, only meaningful for vertices
+    // in front of the near plane. Not thread-safe, counts every read for the reuse statistics.
+    [[nodiscard]] Vec3f fetch(int idx) { ++mStats.fetched; return Vec3f{ mX[idx] / mW[idx], mY[idx] / mW[idx], mZ[idx] / mW[idx] }; }
+    [[nodiscard]] Vec4f fetchClip(int idx) const { return Vec4f{ mX[idx], mY[idx], mZ[idx], mW[idx] }; }
+    [[nodiscard]] std::uint8_t clipCode(int idx) const { return mCodes[idx]; }
+
+    [[nodiscard]] int size() const { return mX.size(); }
+    [[nodiscard]] const Stats& stats() const { return mStats; }
+
+private:
+    // Half-open range of vertex indices
+    struct Range {
+        int begin, end;
+    };
+
+    void transform(const std::vector<Range>& ranges);
+
+    ThreadPool& mPool;
+    const Model *mModel = nullptr;
+    Mat4f mTransform;
+    Rect mViewport{ 0, 0, 0, 0 };
+    std::vector<float> mX;
+    std::vector<float> mY;
+    std::vector<float> mZ;
+    std::vector<float> mW;
+    std::vector<std::uint8_t> mCodes;
+    // A vertex was queued this frame when its stamp equals mFrame
+    std::vector<std::uint32_t> mStamps;
+    std::uint32_t mFrame = 0;
+    std::vector<int> mQueued;
+    std::vector<Range> mRanges;
+    Stats mStats;
+};
+
+#endif //MYRENDERER_VERTEXSTAGE_H
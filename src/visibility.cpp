@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "visibility.h"
+
+VisibilityBuffer::VisibilityBuffer(int width, int height) : mWidth(width), mHeight(height),
+                                                            mSamples(width * height, VisibilitySample{ VisibilitySample::EMPTY, 0, 0 }) {
+}
+
+void VisibilityBuffer::clear() {
+    std::fill(mSamples.begin(), mSamples.end(), VisibilitySample{ VisibilitySample::EMPTY, 0, 0 });
+}
+
+namespace {
+
+// Mip level of a primitive: log2 of texels per pixel, from the texel and screen
+// areas of the triangle that was submitted
+float primitiveLod(const Primitive& prim, const Model& model) {
+    if (prim.area <= 0) return 0.f;
+    Vec2f uv[3];
+    for (int k = 0; k < 3; ++k) {
+        const auto& b = prim.bary[k];
+        uv[k] = model.getUvf(prim.face, 0) * (1.f - b.x - b.y) + model.getUvf(prim.face, 1) * b.x + model.getUvf(prim.face, 2) * b.y;
+    }
+    const auto texels = std::abs((uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y)) * .5f;
+    return texels > 0 ? .5f * std::log2(texels / prim.area) : 0.f;
+}
+
+}
+
+long shadeVisibility(const VisibilityBuffer& vis, const std::vector<Primitive>& primitives, const Model& model,
+                     const Vec3f& lightDir, Framebuffer& frame, ThreadPool& pool) {
+    const auto width = vis.width();
+    const auto& texture = model.diffuse();
+    std::atomic<long> shaded{ 0 };
+    pool.parallelFor(vis.height(), [&](int y) {
+        // Covered pixels of one primitive are sampled 8 at a time with its lod
+        const auto BATCH = 8;
+        float u[BATCH], v[BATCH], ity[BATCH];
+        int xs[BATCH];
+        std::uint32_t texels[BATCH];
+        auto n = 0;
+        auto lod = 0.f;
+        auto *out = frame.row(y);
+        const auto flush = [&]() {
+            if (!n) return;
+            for (int i = n; i < BATCH; ++i) {
+                u[i] = u[n - 1];
+                v[i] = v[n - 1];
+            }
+            texture.sample8(u, v, lod, TextureFilter::Trilinear, texels);
+            for (int i = 0; i < n; ++i) {
+                out[xs[i]] = Framebuffer::pack(Texture::toColor(texels[i]) * ity[i]) | Framebuffer::OPAQUE;
+            }
+            n = 0;
+        };
+
+        auto count = 0;
+        auto lastId = VisibilitySample::EMPTY;
+        const auto *row = vis.data() + y * width;
+        for (int x = 0; x < width; ++x) {
+            const auto& sample = row[x];
+            if (sample.id == VisibilitySample::EMPTY) continue;
+            const auto& prim = primitives[sample.id];
+            if (sample.id != lastId) {
+                flush();
+                lastId = sample.id;
+                lod = primitiveLod(prim, model);
+            }
+
+            // Weights on the submitted triangle, then on the face it was clipped from
+            const auto b1 = sample.b1 / VisibilitySample::ONE;
+            const auto b2 = sample.b2 / VisibilitySample::ONE;
+            const auto fb = prim.bary[0] * (1.f - b1 - b2) + prim.bary[1] * b1 + prim.bary[2] * b2;
+            const float w[3] = { 1.f - fb.x - fb.y, fb.x, fb.y };
+
+            Vec2f uv{ 0, 0 };
+            Vec3f norm{ 0, 0, 0 };
+            for (int j = 0; j < 3; ++j) {
+                uv = uv + model.getUvf(prim.face, j) * w[j];
+                norm = norm + model.getNorm(prim.face, j) * w[j];
+            }
+            u[n] = uv.x;
+            v[n] = uv.y;
+            // A real sqrt, the interpolated normal is no longer unit length. It
+            // vanishes where corner normals oppose each other, that stays unlit.
+            const auto length = norm.norm();
+            ity[n] = length > 1e-6f ? norm * (1.f / length) * lightDir : 0.f;
+            xs[n] = x;
+            if (++n == BATCH) flush();
+            ++count;
+        }
+        flush();
+        shaded += count;
+    });
+    return shaded;
+}
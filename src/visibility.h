@@ -0,0 +1,41 @@
+#ifndef MYRENDERER_VISIBILITY_H
+#define MYRENDERER_VISIBILITY_H
+
+#include <vector>
+
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "primitiveassembly.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+#include "../dependencies/tgaimage.h"
+
+// Per-pixel triangle id and barycentrics of the deferred mode. Rasterizing
+// into it only costs a depth test and an 8 byte store per fragment, shading
+// happens afterwards once per covered pixel.
+class VisibilityBuffer {
+public:
+    VisibilityBuffer(int width, int height);
+
+    void clear();
+
+    [[nodiscard]] VisibilitySample* data() { return mSamples.data(); }
+    [[nodiscard]] const VisibilitySample* data() const { return mSamples.data(); }
+    [[nodiscard]] int width() const { return mWidth; }
+    [[nodiscard]] int height() const { return mHeight; }
+
+private:
+    int mWidth;
+    int mHeight;
+    std::vector<VisibilitySample> mSamples;
+};
+
+// Resolves uv and normal of the face under every covered pixel of vis, samples
+// the diffuse texture trilinearly and lights it with lightDir. Rows are shaded
+// in parallel, runs of one triangle in a row share a mip level.
+// Returns the number of shaded pixels.
+long shadeVisibility(const VisibilityBuffer& vis, const std::vector<Primitive>& primitives, const Model& model,
+                     const Vec3f& lightDir, Framebuffer& frame, ThreadPool& pool);
+
+#endif //MYRENDERER_VISIBILITY_H